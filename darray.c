@@ -8,7 +8,7 @@
  *
  * CREATED:	    04/16/2018
  *
- * LAST EDITED:	    06/04/2018
+ * LAST EDITED:	    10/18/2026
  ***/
 
 /******************************************************************************
@@ -17,24 +17,181 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#if defined(__AVX2__) && defined(__x86_64__)
+#   define CONFIG_DARRAY_AVX2
+#   include <immintrin.h>
+#endif
 
-#include "list.h"
 #include "darray.h"
 
 /******************************************************************************
  * MACRO DEFINITIONS
  ***/
 
-#define Calculate(x) ((int)floor(log((x)/4 + 2) / log(2)) - 1)
-#define Index(i, x) ((i) - ((int)pow(2.0, (num) + 3.0) - 8))
+/* The landing number of index x, the offset of index i in landing x, and one
+ * past the last index held by landing x, for the array a.
+ */
+#define Calculate(a, x) landing_of((a), (x))
+#define Index(a, i, x) ((i) - landing_start((a), (x)))
+#define End(a, x) landing_start((a), (x) + 1)
+
+/* Whether landing n of the array a is split into pages, the number of pages
+ * in it, and the size in bytes of a page.
+ */
+#define Paged(a, n) ((a)->sparse					\
+		     && (a)->fshift + (a)->gshift * (n) > (a)->pshift)
+#define Pages(a, n) (darray_landing_size((a), (n)) >> (a)->pshift)
+#define PageBytes(a) RunBytes((a), (size_t)1 << (a)->pshift)
+
+/* Each run of s slots (a landing, or a page) is followed by its occupancy
+ * bitmap, with a bit for each slot, the bitmap by its summary, with a bit for
+ * each word of the bitmap which may be non-zero, and the summary by the number
+ * of other arrays sharing the run (see darray_clone). These give the number
+ * of words in the bitmap of a run of s slots, the bytes of its slots rounded
+ * up to a word, and the bytes of the whole run, for the array a.
+ */
+#define Words(s) (((size_t)(s) + 63) >> 6)
+#define RunData(a, s) (((size_t)(s) * (a)->elsize + 7) & ~(size_t)7)
+#define RunBytes(a, s) (RunData((a), (s))				\
+			+ (Words(s) + Words(Words(s)) + 1) * sizeof(uint64_t))
+
+/* The bitmap and summary of run r of s slots, and whether the bitmaps of
+ * landing n are kept, for the array a.
+ */
+#define Bitmap(a, r, s) ((uint64_t *)((char *)(r) + RunData((a), (s))))
+#define Summary(a, r, s) (Bitmap((a), (r), (s)) + Words(s))
+#define Tracked(a, n) (!((a)->untracked >> (n) & 1))
+
+/* The share count of run r of s slots, and whether landing n may be shared,
+ * for the array a.
+ */
+#define Refs(a, r, s) ((long long *)((char *)(r) + RunBytes((a), (s)))	\
+		       - 1)
+#define Shared(a, n) ((a)->shared >> (n) & 1)
+
+/* Whether landing n of the array a was carved from its block, and the size of
+ * a piece of `size' bytes within a block.
+ */
+#define Carved(a, n) ((a)->carved >> (n) & 1)
+#define Piece(size) (((size) + _Alignof(max_align_t) - 1)		\
+		     & ~(_Alignof(max_align_t) - 1))
+
+/* The address of element `off' of landing l, and the size in bytes of landing
+ * n (or of its page table, if it is paged), for the array a.
+ */
+#define Slot(a, l, off) ((char *)(l) + (size_t)(off) * (a)->elsize)
+#define Bytes(a, n) (Paged((a), (n)) ? Pages((a), (n)) * sizeof(void *)	\
+		     : RunBytes((a), darray_landing_size((a), (n))))
+
+/* Whether the landing directory of the array a is the one held in its header,
+ * the number of entries in it, and the size in bytes of one allocated.
+ */
+#define Near(a) ((a)->landing == (a)->directory)
+#define Capacity(a) (Near(a) ? CONFIG_DARRAY_INLINE_LANDINGS			\
+		     : DARRAY_MAX_LANDINGS)
+#define DirectoryBytes (DARRAY_MAX_LANDINGS * sizeof(void **))
+
+/* Add n to the counter `field' of the array a (see darray_statistics) */
+#ifdef CONFIG_DARRAY_STATS
+#   define Count(a, field, n)						\
+  ((void)__atomic_fetch_add(&(a)->stats.field, (n), __ATOMIC_RELAXED))
+#else
+#   define Count(a, field, n) ((void)0)
+#endif
+
+/* Whether darray_stdlib_allocator maps an allocation of `size' bytes */
+#define Large(size) (CONFIG_DARRAY_MMAP_THRESHOLD > 0			\
+		     && (size) >= (size_t)CONFIG_DARRAY_MMAP_THRESHOLD)
+
+/* Release `size' bytes at `p' to the allocator of the array a */
+#define Free(a, p, size)					\
+  ((a)->allocator->free((a)->allocator->ctx, (p), (size)))
+
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+/* A single allocation carved into landings by darray_reserve. It is freed when
+ * the last of its pieces is, by whichever array holds it.
+ */
+struct darray_block {
+
+  long long live;
+  long long pieces;
+  size_t bytes;
+
+};
 
 /******************************************************************************
  * STATIC FUNCTION PROTOTYPES
  ***/
 
-static listelmt * get_landing(darray * array, int index, int expand);
+static void * stdlib_alloc(void * ctx, size_t size);
+static void * stdlib_zalloc(void * ctx, size_t size);
+static void stdlib_free(void * ctx, void * ptr, size_t size);
+static void * stdlib_map(size_t size);
+static inline int landing_of(const darray * array, long long index);
+static inline long long landing_start(const darray * array, int num);
+static int valid_config(const darray_config * config);
+static void configure(darray * array, const darray_config * config,
+		      const darray_allocator * allocator, int embedded);
+static int widen(darray * array, int num);
+static int carve(darray * array, int needed);
+static void ** new_landing(darray * array, int num);
+static void ** get_landing(darray * array, int index, int expand);
 static int expand_list(darray * array, int i);
+static void * locate(darray * array, long long index, int expand,
+		     long long * first, long long * end);
+static void free_landing(darray * array, int num);
+static unsigned long long missing(darray * array);
+static void unwind(darray * array, int landings, unsigned long long fresh,
+		   int near);
+static void drop(darray * array, void * run, long long slots, int shared,
+		 int carved);
+static int own(darray * array, long long index);
+static inline void * get_one(darray * array, long long index);
+static inline int set_one(darray * array, long long index, void * data);
+static long long next_index(darray * array);
+static void ** publish_landing(darray * array, int num, int expand);
+static int swap_slot(darray * array, long long index, void * data,
+		     void ** old, int cas);
+static int push_atomic(darray * array, void * data);
+static inline void raise_to(long long * value, long long to);
+static inline int slot_empty(const darray * array, const void * slot);
+static inline void track(darray * array, long long index, void * slot,
+			 long long first, long long end, int on);
+static long long rebuild_bits(darray * array, void * run, long long slots);
+static long long bits_next(darray * array, void * run, long long slots,
+			   long long off);
+static long long bits_prev(darray * array, void * run, long long slots,
+			   long long off);
+static long long seek(darray * array, long long index, int forward);
+static void settle_largest(darray * array);
+static void release_landings(darray * array);
+static int reclaim(darray * array, size_t budget);
+static void * reclaim_main(void * arg);
+#ifdef CONFIG_DARRAY_AVX2
+static int get_many_avx2(darray * array, const int * idx, void ** out,
+			 int n);
+#endif
+
+/******************************************************************************
+ * GLOBAL VARIABLES
+ ***/
+
+/* The allocator used by arrays which are not given one: malloc and friends */
+const darray_allocator darray_stdlib_allocator = {
+  .alloc = stdlib_alloc,
+  .zalloc = stdlib_zalloc,
+  .free = stdlib_free,
+  .ctx = NULL
+};
 
 /******************************************************************************
  * API FUNCTIONS
@@ -44,6 +201,7 @@ static int expand_list(darray * array, int i);
  * FUNCTION:	    darray_create
  *
  * DESCRIPTION:	    Create a new darray structure and return a pointer to it.
+ *		    The array uses the compile-time default landing geometry.
  *
  * ARGUMENTS:	    destroy: (void (*)(void *)) User-defined function which
  *			frees any memory used by a user field.
@@ -54,27 +212,86 @@ static int expand_list(darray * array, int i);
  ***/
 darray * darray_create(void (*destroy)(void *))
 {
-  darray * array = NULL;
-  if ((array = malloc(sizeof(darray))) == NULL)
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.destroy = destroy;
+  return darray_create_ex(&config);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_create_ex
+ *
+ * DESCRIPTION:	    Create a new darray structure with the landing geometry
+ *		    given by `config' and return a pointer to it.
+ *
+ * ARGUMENTS:	    config: (const darray_config *) -- The configuration, or
+ *			NULL for DARRAY_CONFIG_DEFAULT. config->first must be
+ *			a power of two no larger than 2^24,
+ *			config->shift must be between 1 and 8,
+ *			config->elsize no larger than 64KiB, and
+ *			config->page 0 or a power of two no larger than 2^24.
+ *
+ * RETURN:	    (darray *) -- Pointer to a new darray struct, or NULL.
+ *
+ * NOTES:	    O(1)
+ ***/
+darray * darray_create_ex(const darray_config * config)
+{
+  static const darray_config defaults = DARRAY_CONFIG_DEFAULT;
+  if (config == NULL)
+    config = &defaults;
+  if (!valid_config(config))
     return NULL;
 
-  *array = (darray){
-    .size = 0,
-    .last = NULL,
-    .llanding = 0,
-    .largest = 0,
-    .landings = 0,
-    .destroy = destroy
-  };
+  const darray_allocator * allocator = config->allocator != NULL
+    ? config->allocator : &darray_stdlib_allocator;
+  darray * array = NULL;
+  if ((array = allocator->alloc(allocator->ctx, sizeof(darray))) == NULL)
+    return NULL;
 
-  if ((array->buckets = list_create(free)) == NULL) {
-    free(array);
+  /* Readers of a concurrent array cannot follow the directory as it moves */
+  configure(array, config, allocator, 0);
+  if (array->concurrent && widen(array, DARRAY_MAX_LANDINGS - 1)) {
+    Free(array, array, sizeof(darray));
     return NULL;
   }
-
   return array;
 }
 
+/******************************************************************************
+ * FUNCTION:	    darray_init
+ *
+ * DESCRIPTION:	    Initializes a darray structure owned by the caller, for
+ *		    arrays embedded in other objects. The header is never
+ *		    freed by the library, and an array whose first landing
+ *		    fits in the header allocates nothing until it grows past
+ *		    it.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The structure to initialize.
+ *		    size: (size_t) -- sizeof(darray) as the caller sees it, so
+ *			that a caller built with different CONFIG_ settings
+ *			is refused rather than written past.
+ *		    config: (const darray_config *) -- The configuration, as
+ *			for darray_create_ex(), or NULL for the defaults.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(1). The structure must not be moved or copied while it
+ *		    is in use, as the first landing and the directory may lie
+ *		    within it. Release it with darray_fini().
+ ***/
+int darray_init(darray * array, size_t size, const darray_config * config)
+{
+  static const darray_config defaults = DARRAY_CONFIG_DEFAULT;
+  if (config == NULL)
+    config = &defaults;
+  if (array == NULL || size < sizeof(darray) || !valid_config(config))
+    return -1;
+
+  configure(array, config, config->allocator != NULL
+	    ? config->allocator : &darray_stdlib_allocator, 1);
+  return array->concurrent && widen(array, DARRAY_MAX_LANDINGS - 1) ? -1 : 0;
+}
+
 /******************************************************************************
  * FUNCTION:	    darray_get
  *
@@ -86,22 +303,33 @@ darray * darray_create(void (*destroy)(void *))
  *
  * RETURN:	    void * -- Pointer to the user field.
  *
- * NOTES:	    O(logn), E(1) for multiple sequential accesses.
+ * NOTES:	    O(1). Safe to call concurrently with darray_set(),
+ *		    darray_push(), darray_exchange() and darray_cas() on a
+ *		    concurrent array.
  ***/
 void * darray_get(darray * array, int index)
 {
-  if (array == NULL || index < 0 || index > array->largest)
-    return NULL;
+  return get_one(array, index);
+}
 
-  /* Get the number of and a pointer to the landing */
-  int num = Calculate(index);
-  listelmt * l = get_landing(array, num, 0);
-  if (l == NULL)
+/******************************************************************************
+ * FUNCTION:	    darray_get64
+ *
+ * DESCRIPTION:	    Equivalent to darray_get(), for any index up to
+ *		    DARRAY_INDEX_MAX.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    index: (size_t) -- Index desired.
+ *
+ * RETURN:	    void * -- Pointer to the user field.
+ *
+ * NOTES:	    O(1)
+ ***/
+void * darray_get64(darray * array, size_t index)
+{
+  if (index > (size_t)DARRAY_INDEX_MAX)
     return NULL;
-
-  array->llanding = num;
-  array->last = l;
-  return ((void **)l->data)[Index(index, num)];
+  return get_one(array, (long long)index);
 }
 
 /******************************************************************************
@@ -116,157 +344,2712 @@ void * darray_get(darray * array, int index)
  *
  * RETURN:	    int -- 0 if successful, -1 if something bad happened
  *
- * NOTES:	    O(logn), E(1) for multiple sequential accesses.
- *		    TODO: Update to decrease the size of the array if updating
- *			array[highest] to NULL.
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
+ *		    Setting array[largest] to NULL moves largest down, and
+ *		    releases any landings beyond the spares to keep.
  ***/
 int darray_set(darray * array, int index, void * data)
 {
-  if (array == NULL || index < 0)
+  if (array == NULL || index < 0 || array->values)
     return -1;
-  /* This isn't an error...but we don't have to do anything if it's true */
-  if (index > array->largest && data == NULL)
-    return 0;
+  return set_one(array, index, data);
+}
 
-  /* Get the number of and a pointer to the landing */
-  int num = Calculate(index);
-  listelmt * l = get_landing(array, num, 1);
+/******************************************************************************
+ * FUNCTION:	    darray_set64
+ *
+ * DESCRIPTION:	    Equivalent to darray_set(), for any index up to
+ *		    DARRAY_INDEX_MAX.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (size_t) -- The index in the array.
+ *		    data: (void *) -- The data to populate the array with.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
+ ***/
+int darray_set64(darray * array, size_t index, void * data)
+{
+  if (array == NULL || index > (size_t)DARRAY_INDEX_MAX || array->values)
+    return -1;
+  return set_one(array, (long long)index, data);
+}
 
-  if (index > array->largest)
-    array->largest = index;
+/******************************************************************************
+ * FUNCTION:	    darray_cursor_seek
+ *
+ * DESCRIPTION:	    The slow path of darray_cursor_get(): looks up the landing
+ *		    holding `index', and caches it in `cursor'.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    cursor: (darray_cursor *) -- The caller's cursor.
+ *		    index: (long long) -- Index desired.
+ *
+ * RETURN:	    void * -- Pointer to the user field.
+ *
+ * NOTES:	    O(1). Writes only to `cursor'.
+ ***/
+void * darray_cursor_seek(darray * array, darray_cursor * cursor,
+			  long long index)
+{
+  if (array == NULL || cursor == NULL || array->values)
+    return NULL;
+  Count(array, gets, 1);
+  Count(array, cursor_misses, 1);
+  if (index < 0 || index > DARRAY_INDEX_MAX
+      || index > __atomic_load_n(&array->largest, __ATOMIC_ACQUIRE))
+    return NULL;
 
-  array->llanding = num;
-  array->last = l;
-  array->size++;
-  ((void **)l->data)[Index(index, num)] = data;
-  return 0;
+  if (array->sparse) {
+    long long first = 0, end = 0;
+    void ** slot = locate(array, index, 0, &first, &end);
+    if (slot == NULL)
+      return NULL;
+    cursor->base = slot - (index - first);
+    cursor->first = first;
+    cursor->end = end;
+    return *slot;
+  }
+
+  int num = Calculate(array, index);
+  void ** l = __atomic_load_n(&array->landing[num], __ATOMIC_ACQUIRE);
+  if (l == NULL)
+    return NULL;
+
+  cursor->base = l;
+  cursor->first = landing_start(array, num);
+  cursor->end = End(array, num);
+  return __atomic_load_n(&l[index - cursor->first], __ATOMIC_ACQUIRE);
 }
 
 /******************************************************************************
- * FUNCTION:	    darray_destroy
+ * FUNCTION:	    darray_exchange
  *
- * DESCRIPTION:	    This function frees all memory which has been internally
- *		    associated with the array. If a function was passed to the
- *		    function darray_create() when the list was created, this
- *		    function will invoke it on all non-NULL entries in the
- *		    array. This is useful, for instance, in freeing user memory
- *		    when it is no longer needed, or notifying a structure of an
- *		    event. Please note that the user function will be called on
- *		    ONLY the non-NULL elements in the array. This is to
- *		    mitigate the time spent inside of this function.
+ * DESCRIPTION:	    Atomically sets the element at `index' to `data', and
+ *		    returns the element it replaced.
  *
- * ARGUMENTS:	    array: (darray **) -- Pointer to the array to destroy.
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (int) -- The index in the array.
+ *		    data: (void *) -- The data to populate the array with.
  *
- * RETURN:	    void
+ * RETURN:	    void * -- The previous element, or NULL if there was none
+ *		    or something bad happened.
  *
- * NOTES:	    TODO: Implement darray->min and darray_min()
- *		    TODO: Implement bucket->containing
- *			The number of non-NULL elements in the array
- *		    TODO: Make the size of the initial bucket configurable
- *			(via a macro)
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
  ***/
-void darray_destroy(darray ** array)
+void * darray_exchange(darray * array, int index, void * data)
 {
-  if (array == NULL || *array == NULL)
-    return;
+  void * old = NULL;
+  if (array == NULL || index < 0 || array->values)
+    return NULL;
+  Count(array, sets, 1);
+  if (swap_slot(array, index, data, &old, 0))
+    return NULL;
+  return old;
+}
 
-  listelmt * l = NULL;
-  int i = 8;
-  for (l = (*array)->buckets->head; l != NULL; l = l->next) {
-    if ((*array)->destroy != NULL) {
-      for (int j = 0; j < i; j++) {
-	if (((void **)l->data)[j] != NULL) {
-	  (*array)->destroy(((void **)l->data)[j]);
-	}
+/******************************************************************************
+ * FUNCTION:	    darray_cas
+ *
+ * DESCRIPTION:	    Atomically sets the element at `index' to `desired', but
+ *		    only if it currently holds `expected'.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (int) -- The index in the array.
+ *		    expected: (void *) -- The element expected at `index'.
+ *		    desired: (void *) -- The data to populate the array with.
+ *
+ * RETURN:	    int -- 1 if the element was replaced, 0 if it did not hold
+ *		    `expected', -1 if something bad happened.
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
+ ***/
+int darray_cas(darray * array, int index, void * expected, void * desired)
+{
+  if (array == NULL || index < 0 || array->values)
+    return -1;
+  Count(array, sets, 1);
+
+  int ret = swap_slot(array, index, desired, &expected, 1);
+  return ret < 0 ? -1 : !ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_slot
+ *
+ * DESCRIPTION:	    Returns the address of the element at `index', for arrays
+ *		    of inline values (or of the pointer at `index', for arrays
+ *		    of pointers). If `expand' is non-zero, the landing is
+ *		    allocated if necessary, and darray_largest() is raised to
+ *		    `index', so that the caller may write through the pointer.
+ *		    Such writes are not reflected in darray_size(), and the
+ *		    occupancy bitmaps of the landing are no longer kept,
+ *		    until darray_retrack() is called. A concurrent array
+ *		    may not be expanded this way.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    index: (long long) -- Index desired, up to DARRAY_INDEX_MAX.
+ *		    expand: (int) -- non-zero if we are allowed to expand.
+ *
+ * RETURN:	    void * -- Pointer to the element, or NULL if its landing
+ *		    has not been allocated (or could not be).
+ *
+ * NOTES:	    O(1)
+ ***/
+void * darray_slot(darray * array, long long index, int expand)
+{
+  if (array == NULL || index < 0 || index > DARRAY_INDEX_MAX)
+    return NULL;
+
+  long long first = 0, end = 0;
+  if (expand && (array->concurrent || array->readonly
+		 || (array->shared != 0 && own(array, index))))
+    return NULL;
+  void * slot = locate(array, index, expand, &first, &end);
+  if (slot == NULL)
+    return NULL;
+
+  /* The caller may fill the landing behind our back */
+  if (expand) {
+    array->untracked |= 1ull << Calculate(array, index);
+    if (index > array->largest)
+      array->largest = index;
+  }
+  return slot;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_retrack
+ *
+ * DESCRIPTION:	    Rebuilds the occupancy bitmaps of the landings written
+ *		    through darray_slot(), so that darray_next() and friends
+ *		    use them again, and recounts darray_size().
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(n) in the slots of the landings rebuilt, plus O(n/64) in
+ *		    the rest. Not for concurrent or mapped arrays.
+ ***/
+int darray_retrack(darray * array)
+{
+  if (array == NULL || array->concurrent || array->mapped)
+    return -1;
+
+  long long size = 0;
+  for (int n = 0; n < array->landings; n++) {
+    int paged = Paged(array, n);
+    long long slots = paged ? 1ll << array->pshift
+      : (long long)darray_landing_size(array, n);
+    size_t runs = paged ? Pages(array, n) : 1;
+    for (size_t r = 0; array->landing[n] != NULL && r < runs; r++) {
+      long long first = landing_start(array, n) + (long long)r * slots;
+      if (!Tracked(array, n) && array->shared != 0 && own(array, first))
+	return -1;
+      void * run = paged ? array->landing[n][r] : (void *)array->landing[n];
+      if (run == NULL)
+	continue;
+      if (!Tracked(array, n)) {
+	size += rebuild_bits(array, run, slots);
+	continue;
       }
+      const uint64_t * bits = Bitmap(array, run, slots);
+      for (size_t w = 0; w < Words(slots); w++)
+	size += __builtin_popcountll(bits[w]);
     }
-
-    i <<= 1;
+    array->untracked &= ~(1ull << n);
   }
 
-  list_destroy(&((*array)->buckets));
-  free(*array);
-  *array = NULL;
+  array->size = size;
+  return 0;
 }
 
 /******************************************************************************
- * STATIC FUNCTIONS
+ * FUNCTION:	    darray_set_value
+ *
+ * DESCRIPTION:	    Copies the element at `value' into the array at `index',
+ *		    for arrays of inline values. An element whose bytes are
+ *		    all zero is empty, just as NULL is for pointer arrays.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (int) -- The index in the array.
+ *		    value: (const void *) -- Pointer to the element to copy,
+ *			of the array's element size.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings. Not
+ *		    for concurrent arrays.
  ***/
+int darray_set_value(darray * array, int index, const void * value)
+{
+  if (array == NULL || index < 0 || value == NULL || array->concurrent
+      || array->readonly)
+    return -1;
+  Count(array, sets, 1);
+
+  int empty = slot_empty(array, value);
+  if (index > array->largest && empty)
+    return 0;
+  if (array->shared != 0 && own(array, index))
+    return -1;
+
+  long long first = 0, end = 0;
+  void * slot = locate(array, index, !empty, &first, &end);
+  if (slot == NULL)
+    return empty ? 0 : -1;
+
+  int was = slot_empty(array, slot);
+  if (was != empty) {
+    array->size += was ? 1 : -1;
+    track(array, index, slot, first, end, was);
+  }
+  memcpy(slot, value, array->elsize);
+
+  if (index > array->largest)
+    array->largest = index;
+  else if (index == array->largest && empty)
+    settle_largest(array);
+  return 0;
+}
 
 /******************************************************************************
- * FUNCTION:	    get_landing
+ * FUNCTION:	    darray_get_many
  *
- * DESCRIPTION:	    Returns a pointer to the landing specified, optionally
- *		    expanding the list on the way up, if necessary.
+ * DESCRIPTION:	    Gathers the user fields stored at each of the `n' indices
+ *		    in `idx' into `out'. Indices which are out of range yield
+ *		    NULL, just as with darray_get(). When compiled for AVX2,
+ *		    eight indices are resolved at a time.
  *
- * ARGUMENTS:	    array: (darray *) -- pointer to the array we're searching.
- *		    index: (int) -- The nth landing in the array.
- *		    expand: (int) -- non-zero if we are allowed to expand.
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    idx: (const int *) -- The indices desired.
+ *		    out: (void **) -- Receives the `n' user fields.
+ *		    n: (int) -- The number of indices in `idx'.
  *
- * RETURN:	    listelmt * -- Pointer to the landing.
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
  *
- * NOTES:	    O(logn), E(1) - Optimized for sequential access.
+ * NOTES:	    O(n)
  ***/
-static listelmt * get_landing(darray * array, int index, int expand)
+int darray_get_many(darray * array, const int * idx, void ** out, int n)
 {
-  /* Get the index */
-  listelmt * l = array->buckets->head;
+  if (array == NULL || array->values || n < 0
+      || (n > 0 && (idx == NULL || out == NULL)))
+    return -1;
+  Count(array, gets, n);
+
   int i = 0;
+#ifdef CONFIG_DARRAY_AVX2
+  if (array->gshift == 1 && !array->sparse)
+    i = get_many_avx2(array, idx, out, n);
+#endif
+  for (; i < n; i++) {
+    int index = idx[i];
+    out[i] = NULL;
+    if (index < 0 || index > array->largest)
+      continue;
 
-  /* Figure out if we've been here before */
-  if (index == array->llanding && array->last != NULL)
-    l = array->last;
-  else
-    for (i = index; i > 0 && l != NULL; i--)
-      l = l->next;
+    long long first = 0, end = 0;
+    void ** slot = locate(array, index, 0, &first, &end);
+    if (slot != NULL)
+      out[i] = *slot;
+  }
 
-  /* We might be done here. If that's the case, return */
-  if (l != NULL)
-    return l;
+  return 0;
+}
 
-  /* Expand the list if we are allowed to, and need to */
-  if (expand && expand_list(array, i))
-    return NULL;
-  /* Navigate to the correct landing, now that we've initialized it. */
-  l = array->buckets->head;
-  for (i = index; i > 0 && l != NULL; i--)
-    l = l->next;
+/******************************************************************************
+ * FUNCTION:	    darray_set_many
+ *
+ * DESCRIPTION:	    Sets the element at each of the `n' indices in `idx' to
+ *		    the corresponding pointer in `data'. This is equivalent to
+ *		    calling darray_set() on each pair, in order.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    idx: (const int *) -- The indices in the array.
+ *		    data: (void * const *) -- The data to populate with.
+ *		    n: (int) -- The number of indices in `idx'.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. On
+ *		    failure, the elements preceding the bad one are set.
+ *
+ * NOTES:	    O(n), plus the cost of allocating any new landings.
+ ***/
+int darray_set_many(darray * array, const int * idx, void * const * data,
+		    int n)
+{
+  if (array == NULL || array->values || n < 0
+      || (n > 0 && (idx == NULL || data == NULL)))
+    return -1;
 
-  return l;
+  for (int i = 0; i < n; i++) {
+    if (idx[i] < 0 || set_one(array, idx[i], data[i]))
+      return -1;
+  }
+
+  return 0;
 }
 
 /******************************************************************************
- * FUNCTION:	    expand_list
+ * FUNCTION:	    darray_set_spare
  *
- * DESCRIPTION:	    Expands the array by `i' landings.
+ * DESCRIPTION:	    Sets the number of empty landings the array keeps beyond
+ *		    the one holding darray_largest() when it contracts, and
+ *		    releases any landings in excess of that immediately.
  *
- * ARGUMENTS:	    array: (darray *) -- The array to expand.
- *		    i: (int) -- The number of landings to add to the array.
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    spare: (int) -- The number of spare landings to keep.
  *
- * RETURN:	    int -- 0 on success, -1 on failure.
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
  *
  * NOTES:	    O(1)
  ***/
-static int expand_list(darray * array, int i)
+int darray_set_spare(darray * array, int spare)
 {
-  if (i < 0)
+  if (array == NULL || spare < 0)
     return -1;
 
-  void ** data = NULL;
-  while (i-- >= 0) {
-    /* TODO: Check the floating point environment here */
-    if ((data = calloc((size_t)pow(2.0, 3.0 + (double)array->landings++),
-		       sizeof(void *))) == NULL)
-      return -1;
-    if (list_insnxt(array->buckets,
-		    array->buckets->tail,
-		    (void *)data) == -1) {
-      free(data);
+  array->spare = spare;
+  release_landings(array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_reserve
+ *
+ * DESCRIPTION:	    Allocates every landing needed to hold the indices 0
+ *		    through n - 1, from a single allocation carved into
+ *		    landings, so that an array whose final size is known grows
+ *		    no further, and its landings lie next to one another.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    n: (long long) -- The number of slots to reserve.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(landings). A first landing which fits in the header is
+ *		    not carved, nor are pages: a sparse array carves only its
+ *		    landings which are not split into pages, and allocates
+ *		    the page tables of the rest. A concurrent array, or one
+ *		    still holding landings carved by an earlier call, has its
+ *		    landings allocated one at a time as usual. The landings
+ *		    reserved are kept when the array contracts, until
+ *		    darray_shrink_to_fit() is called.
+ ***/
+int darray_reserve(darray * array, long long n)
+{
+  if (array == NULL || array->readonly || n < 0 || n > DARRAY_INDEX_MAX + 1)
+    return -1;
+  if (n == 0)
+    return 0;
+
+  int needed = Calculate(array, n - 1) + 1;
+  if (array->concurrent) {
+    if (publish_landing(array, needed - 1, 1) == NULL)
       return -1;
+  } else if (array->carved != 0) {
+    for (int k = 0; k < needed; k++) {
+      if (get_landing(array, k, 1) == NULL)
+	return -1;
     }
+  } else if (carve(array, needed)) {
+    return -1;
   }
 
+  /* Only a reservation which was allocated is kept through contraction */
+  if (array->reserved < needed)
+    array->reserved = needed;
   return 0;
 }
 
+/******************************************************************************
+ * FUNCTION:	    darray_shrink_to_fit
+ *
+ * DESCRIPTION:	    Releases every landing past the one holding the largest
+ *		    element, spares and reserved landings included. If that
+ *		    leaves part of a block carved by darray_reserve() unused,
+ *		    the landings still in use are moved out of it, so that it
+ *		    can be freed.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. On
+ *		    failure, the array still reads the same.
+ *
+ * NOTES:	    O(1), or O(n) when landings are moved. A landing directory
+ *		    which fits in the header again is moved back into it. Not
+ *		    for concurrent arrays, whose landings are never released.
+ ***/
+int darray_shrink_to_fit(darray * array)
+{
+  if (array == NULL || array->concurrent || array->readonly)
+    return -1;
+
+  int keep = array->size == 0 ? 0 : Calculate(array, array->largest) + 1;
+  array->reserved = 0;
+  while (array->landings > keep)
+    free_landing(array, --array->landings);
+  if (!Near(array) && array->landings <= CONFIG_DARRAY_INLINE_LANDINGS) {
+    memcpy(array->directory, array->landing, sizeof(array->directory));
+    Free(array, array->landing, DirectoryBytes);
+    array->landing = array->directory;
+  }
+
+  struct darray_block * block = array->block;
+  if (block == NULL
+      || __atomic_load_n(&block->live, __ATOMIC_ACQUIRE) == block->pieces)
+    return 0;
+
+  for (int n = 0; array->carved != 0 && n < array->landings; n++) {
+    if (!Carved(array, n))
+      continue;
+
+    void * copy = NULL;
+    long long slots = darray_landing_size(array, n);
+    size_t bytes = RunBytes(array, slots);
+    if ((copy = array->allocator->alloc(array->allocator->ctx, bytes)) == NULL)
+      return -1;
+    memcpy(copy, array->landing[n], bytes);
+    *Refs(array, copy, slots) = 0;
+    drop(array, array->landing[n], slots, Shared(array, n), 1);
+    array->landing[n] = copy;
+    array->shared &= ~(1ull << n);
+    array->carved &= ~(1ull << n);
+  }
+
+  array->block = NULL;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_compact
+ *
+ * DESCRIPTION:	    Moves every element of the array down to the lowest
+ *		    indices, keeping their order, so that the array holds
+ *		    elements at 0 through darray_size() - 1 only. The landings
+ *		    (and, for a sparse array, the pages) left empty are then
+ *		    released, as when the array contracts.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    remap: (darray_remap_fn) -- Called with the old and new
+ *			index of each element which moves, or NULL.
+ *		    ctx: (void *) -- Passed to `remap'.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. If a
+ *		    page could not be allocated for a sparse array, the
+ *		    elements moved so far have been reported, and the rest
+ *		    are where they were.
+ *
+ * NOTES:	    O(n), skipping empty words of the occupancy bitmaps.
+ *		    Elements written through darray_slot() are moved too, and
+ *		    counted by darray_size() afterwards. Not for concurrent
+ *		    arrays, whose landings are never released.
+ ***/
+int darray_compact(darray * array, darray_remap_fn remap, void * ctx)
+{
+  if (array == NULL || array->concurrent || array->readonly)
+    return -1;
+
+  /* Walk the runs as darray_foreach_nonnull() does, filling from the bottom.
+   * The slot written is never above the slot read, so each element is read
+   * before anything is moved over it.
+   */
+  long long to = 0, first = 0, end = 0, lo = 0, hi = 0;
+  char * into = NULL;
+  int ret = 0;
+  for (long long index = 0; ret == 0 && index <= array->largest;
+       index = end) {
+    if (array->shared != 0 && own(array, index)) {
+      ret = -1;
+      break;
+    }
+    char * slot = locate(array, index, 0, &first, &end);
+    if (slot == NULL)
+      continue;
+
+    char * run = slot - (size_t)(index - first) * array->elsize;
+    long long slots = end - first;
+    long long stop = (end <= array->largest ? end : array->largest + 1) - first;
+    int tracked = Tracked(array, Calculate(array, index));
+    for (long long off = index - first; off < stop; off++) {
+      if (tracked && (off = bits_next(array, run, slots, off)) < 0)
+	break;
+      char * from = Slot(array, run, off);
+      if (off >= stop || slot_empty(array, from))
+	continue;
+
+      if (first + off != to) {
+	if (to < lo || to >= hi) {
+	  if ((into = locate(array, to, 1, &lo, &hi)) == NULL) {
+	    ret = -1;
+	    break;
+	  }
+	  into -= (size_t)(to - lo) * array->elsize;
+	}
+
+	char * dest = Slot(array, into, to - lo);
+	memcpy(dest, from, array->elsize);
+	memset(from, 0, array->elsize);
+	track(array, to, dest, lo, hi, 1);
+	track(array, first + off, from, first, end, 0);
+	if (remap != NULL)
+	  remap(first + off, to, ctx);
+      }
+      to++;
+    }
+  }
+
+  if (ret != 0) {
+    settle_largest(array);
+    return -1;
+  }
+
+  array->size = to;
+  array->largest = to > 0 ? to - 1 : 0;
+  release_landings(array);
+
+  /* The pages above the last element of its landing are empty now, too */
+  int num = Calculate(array, array->largest);
+  if (to > 0 && Paged(array, num)) {
+    void ** l = array->landing[num];
+    size_t page = ((array->largest - landing_start(array, num))
+		   >> array->pshift) + 1;
+    for (; page < Pages(array, num); page++) {
+      if (l[page] != NULL) {
+	drop(array, l[page], 1ll << array->pshift, Shared(array, num), 0);
+	Count(array, pages_freed, 1);
+	l[page] = NULL;
+      }
+    }
+  }
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_clone
+ *
+ * DESCRIPTION:	    Returns a copy of the array which shares its landings,
+ *		    rather than copying its elements. Each landing (or, in a
+ *		    sparse array, each page) is copied only when one of the
+ *		    arrays sharing it first writes to it, so a snapshot of an
+ *		    array which keeps changing only ever copies what changes.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to clone.
+ *
+ * RETURN:	    darray * -- The clone, or NULL if something bad happened.
+ *
+ * NOTES:	    O(landings), or O(pages) for a sparse array. The clone
+ *		    shares the elements of an array of pointers too, so it has
+ *		    no destroy function. Each array may then be used from its
+ *		    own thread, but writes through darray_span_next() and
+ *		    friends, or darray_slot() without `expand', must be
+ *		    preceded by darray_unshare(). A write to a shared landing
+ *		    replaces it with a copy, so the cursors of the array
+ *		    written must then be reset. Concurrent and mapped arrays
+ *		    cannot be cloned.
+ ***/
+darray * darray_clone(darray * array)
+{
+  if (array == NULL || array->concurrent || array->mapped)
+    return NULL;
+
+  darray * copy = NULL;
+  if ((copy = array->allocator->alloc(array->allocator->ctx,
+				      sizeof(darray))) == NULL)
+    return NULL;
+  memcpy(copy, array, sizeof(darray));
+  copy->destroy = NULL;
+  copy->embedded = 0;
+#ifdef CONFIG_DARRAY_STATS
+  memset(&copy->stats, 0, sizeof(copy->stats));
+#endif
+
+  /* The copy gets a directory of its own, if the array has outgrown its own */
+  copy->landing = copy->directory;
+  if (!Near(array)) {
+    if (widen(copy, DARRAY_MAX_LANDINGS - 1)) {
+      Free(array, copy, sizeof(darray));
+      return NULL;
+    }
+    memcpy(copy->landing, array->landing, DirectoryBytes);
+  }
+
+  /* A first landing within the header was copied along with it. A paged
+   * landing gets a page table of its own, sharing each page.
+   */
+  for (int n = 0; n < array->landings; n++) {
+    void ** l = array->landing[n];
+    if (l == NULL)
+      continue;
+    if (l == (void **)array->local) {
+      copy->landing[n] = (void **)copy->local;
+      continue;
+    }
+
+    if (Paged(array, n)) {
+      void ** table = NULL;
+      if ((table = array->allocator->alloc(array->allocator->ctx,
+					   Bytes(array, n))) == NULL) {
+	memset(&copy->landing[n], 0, (Capacity(copy) - n) * sizeof(void **));
+	copy->landings = n;
+	reclaim(copy, SIZE_MAX);
+	return NULL;
+      }
+      memcpy(table, l, Bytes(array, n));
+      for (size_t p = 0; p < Pages(array, n); p++) {
+	if (l[p] != NULL)
+	  __atomic_fetch_add(Refs(array, l[p], 1ll << array->pshift), 1,
+			     __ATOMIC_RELAXED);
+      }
+      copy->landing[n] = table;
+    } else {
+      __atomic_fetch_add(Refs(array, l, darray_landing_size(array, n)), 1,
+			 __ATOMIC_RELAXED);
+    }
+    array->shared |= 1ull << n;
+    copy->shared |= 1ull << n;
+  }
+
+  return copy;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_unshare
+ *
+ * DESCRIPTION:	    Gives the array a private copy of every landing and page
+ *		    it still shares with a clone, so that it may be written
+ *		    through pointers handed out by darray_span_next(),
+ *		    darray_slot() and friends.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. On
+ *		    failure, the array still reads the same, but may share
+ *		    some runs.
+ *
+ * NOTES:	    O(landings), or O(pages) for a sparse array, plus the
+ *		    cost of copying the runs still shared.
+ ***/
+int darray_unshare(darray * array)
+{
+  if (array == NULL)
+    return -1;
+
+  for (int n = 0; array->shared != 0 && n < array->landings; n++) {
+    if (!Shared(array, n))
+      continue;
+    long long step = Paged(array, n) ? 1ll << array->pshift
+      : (long long)darray_landing_size(array, n);
+    for (long long index = landing_start(array, n); index < End(array, n);
+	 index += step) {
+      if (own(array, index))
+	return -1;
+    }
+    array->shared &= ~(1ull << n);
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_push
+ *
+ * DESCRIPTION:	    Appends `data' to the array, at the index following
+ *		    darray_largest(), or at 0 if the array is empty.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    data: (void *) -- The data to append. Must be non-NULL.
+ *
+ * RETURN:	    int -- The index of the new element, or -1 if something bad
+ *		    happened.
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings. On a
+ *		    concurrent array, the index is claimed with a CAS, so
+ *		    several threads may push at once.
+ ***/
+int darray_push(darray * array, void * data)
+{
+  if (array == NULL || data == NULL || array->values)
+    return -1;
+  if (array->concurrent) {
+    Count(array, sets, 1);
+    return push_atomic(array, data);
+  }
+
+  long long index = next_index(array);
+  if (index < 0 || index > INT_MAX || set_one(array, index, data))
+    return -1;
+  return (int)index;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_append_range
+ *
+ * DESCRIPTION:	    Appends the `n' pointers in `src' to the array, beginning
+ *		    at the index darray_push() would use. Every landing needed
+ *		    is allocated up front, and each is filled with one memcpy.
+ *		    NULL entries in `src' leave their slot empty.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    src: (void * const *) -- The data to append.
+ *		    n: (int) -- The number of pointers in `src'.
+ *
+ * RETURN:	    int -- The index of src[0] in the array, or -1 if something
+ *		    bad happened. On failure, the array is unchanged.
+ *
+ * NOTES:	    O(n). Not for concurrent arrays, whose landings are only
+ *		    published one at a time; use darray_push() instead.
+ ***/
+int darray_append_range(darray * array, void * const * src, int n)
+{
+  if (array == NULL || array->values || array->concurrent || n < 0
+      || (n > 0 && src == NULL))
+    return -1;
+
+  long long next = next_index(array);
+  if (next < 0 || next > INT_MAX || n > INT_MAX - next)
+    return -1;
+  int first = (int)next;
+  if (n == 0)
+    return first;
+  Count(array, sets, n);
+
+  /* Allocate every run first, so that the array is unchanged on failure */
+  int landings = array->landings, near = Near(array);
+  unsigned long long fresh = missing(array);
+  long long from = 0, end = 0;
+  for (long long index = first; index < first + n; index = end) {
+    if ((array->shared != 0 && own(array, index))
+	|| locate(array, index, 1, &from, &end) == NULL) {
+      unwind(array, landings, fresh, near);
+      return -1;
+    }
+  }
+
+  int largest = -1;
+  for (int i = 0; i < n; i++) {
+    if (src[i] != NULL) {
+      array->size++;
+      largest = i;
+    }
+  }
+
+  for (int index = first; index < first + n;) {
+    void ** slot = locate(array, index, 0, &from, &end);
+    int count = (int)(end < first + n ? end - index : first + n - index);
+    memcpy(slot, src + (index - first), count * sizeof(void *));
+    for (int i = 0; i < count; i++) {
+      if (slot[i] != NULL)
+	track(array, index + i, &slot[i], from, end, 1);
+    }
+    index += count;
+  }
+
+  if (largest >= 0)
+    array->largest = first + largest;
+  return first;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_fill
+ *
+ * DESCRIPTION:	    Sets every element with an index in [from, to) to `value'.
+ *		    Every landing needed is allocated up front.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    from: (int) -- The first index to set.
+ *		    to: (int) -- One past the last index to set.
+ *		    value: (void *) -- The data to populate the range with.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. On
+ *		    failure, the array still reads the same.
+ *
+ * NOTES:	    O(to - from). Not for concurrent arrays.
+ ***/
+int darray_fill(darray * array, int from, int to, void * value)
+{
+  if (array == NULL || array->values || array->concurrent || from < 0
+      || to < from)
+    return -1;
+
+  /* Clearing past the largest element has no effect */
+  if (value == NULL && to > array->largest + 1)
+    to = (int)(array->largest + 1);
+  if (from >= to)
+    return 0;
+  Count(array, sets, to - from);
+
+  int landings = array->landings, near = Near(array);
+  unsigned long long fresh = missing(array);
+  long long first = 0, end = 0;
+  for (long long index = from; index < to; index = end) {
+    if ((array->shared != 0 && own(array, index))
+	|| (locate(array, index, value != NULL, &first, &end) == NULL
+	    && value != NULL)) {
+      unwind(array, landings, fresh, near);
+      return -1;
+    }
+  }
+
+  for (int index = from; index < to;) {
+    void ** l = locate(array, index, 0, &first, &end);
+    int count = (int)(end < to ? end - index : to - index);
+    for (int i = 0; l != NULL && i < count; i++) {
+      if ((l[i] == NULL) != (value == NULL)) {
+	array->size += value != NULL ? 1 : -1;
+	track(array, index + i, &l[i], first, end, value != NULL);
+      }
+      l[i] = value;
+    }
+    index += count;
+  }
+
+  if (value != NULL && to - 1 > array->largest)
+    array->largest = to - 1;
+  else if (value == NULL && to > array->largest)
+    settle_largest(array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_copy_out
+ *
+ * DESCRIPTION:	    Copies the elements with an index in [from, to) into `dst',
+ *		    with one memcpy per landing. Indices which have never been
+ *		    allocated yield NULL.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    from: (int) -- The first index to copy.
+ *		    to: (int) -- One past the last index to copy.
+ *		    dst: (void **) -- Receives (to - from) pointers.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(to - from)
+ ***/
+int darray_copy_out(darray * array, int from, int to, void ** dst)
+{
+  if (array == NULL || array->values || from < 0 || to < from
+      || (to > from && dst == NULL))
+    return -1;
+
+  long long first = 0, end = 0;
+  for (int index = from; index < to;) {
+    void ** slot = locate(array, index, 0, &first, &end);
+    int count = (int)(end < to ? end - index : to - index);
+    if (slot != NULL && index <= array->largest)
+      memcpy(dst + (index - from), slot, count * sizeof(void *));
+    else
+      memset(dst + (index - from), 0, count * sizeof(void *));
+    index += count;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_span_next
+ *
+ * DESCRIPTION:	    Advances `span' to the next contiguous run of slots in the
+ *		    array. A run never crosses a landing (or in a sparse
+ *		    array, a page) boundary, and never extends past
+ *		    darray_largest(). Pages which have not been allocated are
+ *		    skipped.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    span: (darray_span *) -- The previous span, or a span
+ *			initialized with DARRAY_SPAN_INIT.
+ *
+ * RETURN:	    int -- 1 if `span' now holds the next run, 0 if there are
+ *		    no more runs, -1 if something bad happened.
+ *
+ * NOTES:	    O(1)
+ ***/
+int darray_span_next(darray * array, darray_span * span)
+{
+  if (array == NULL || span == NULL || span->first < 0 || span->count < 0)
+    return -1;
+
+  /* Runs which have not been allocated (only in sparse arrays) are skipped */
+  long long index = span->first + span->count, first = 0, end = 0;
+  void * base = NULL;
+  for (; index <= array->largest; index = end) {
+    Count(array, walked, 1);
+    if ((base = locate(array, index, 0, &first, &end)) != NULL)
+      break;
+  }
+  if (base == NULL)
+    return 0;
+
+  if (end > array->largest + 1)
+    end = array->largest + 1;
+  if (end - index > INT_MAX)
+    end = index + INT_MAX;
+
+  span->base = (void **)base;
+  span->first = index;
+  span->count = (int)(end - index);
+  return 1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_foreach_span
+ *
+ * DESCRIPTION:	    Invokes `cb' on each contiguous run of slots in the array,
+ *		    in order of increasing index. This allows the caller to
+ *		    iterate over each landing with a tight loop.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    cb: (darray_span_fn) -- User function, called with the
+ *			base, first index and length of each run.
+ *		    ctx: (void *) -- Passed through to `cb'.
+ *
+ * RETURN:	    int -- 0 if every run was visited, the non-zero value
+ *		    returned by `cb' if it stopped the iteration, or -1 if
+ *		    something bad happened.
+ *
+ * NOTES:	    O(logn) calls to `cb'.
+ ***/
+int darray_foreach_span(darray * array, darray_span_fn cb, void * ctx)
+{
+  if (array == NULL || cb == NULL)
+    return -1;
+
+  int ret = 0;
+  darray_span span = DARRAY_SPAN_INIT;
+  while (darray_span_next(array, &span) == 1) {
+    if ((ret = cb(span.base, span.first, span.count, ctx)) != 0)
+      return ret;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_foreach_nonnull
+ *
+ * DESCRIPTION:	    Invokes `cb' on each non-NULL element of the array, in
+ *		    order of increasing index.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    cb: (darray_elem_fn) -- User function, called with the
+ *			index and user field of each non-NULL element.
+ *		    ctx: (void *) -- Passed through to `cb'.
+ *
+ * RETURN:	    int -- 0 if every element was visited, the non-zero value
+ *		    returned by `cb' if it stopped the iteration, or -1 if
+ *		    something bad happened.
+ *
+ * NOTES:	    O(n)
+ ***/
+int darray_foreach_nonnull(darray * array, darray_elem_fn cb, void * ctx)
+{
+  if (array == NULL || cb == NULL || array->values)
+    return -1;
+
+  /* Visit each run, skipping its empty slots with the bitmap if it is kept */
+  int ret = 0;
+  long long index = 0, first = 0, end = 0;
+  for (; index <= array->largest; index = end) {
+    void ** slot = locate(array, index, 0, &first, &end);
+    if (slot == NULL)
+      continue;
+
+    void ** run = slot - (index - first);
+    long long stop = (end <= array->largest ? end : array->largest + 1) - first;
+    int tracked = Tracked(array, Calculate(array, index));
+    for (long long off = index - first; off < stop; off++) {
+      if (tracked && (off = bits_next(array, run, end - first, off)) < 0)
+	break;
+      if (off < stop && run[off] != NULL
+	  && (ret = cb(first + off, run[off], ctx)) != 0)
+	return ret;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_min
+ *
+ * DESCRIPTION:	    Returns the smallest index holding an element.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *
+ * RETURN:	    long long -- The index, or -1 if the array is empty.
+ *
+ * NOTES:	    O(n/64) in the number of leading NULL elements, using the
+ *		    occupancy bitmaps. Landings written through darray_slot()
+ *		    are scanned slot by slot.
+ ***/
+long long darray_min(darray * array)
+{
+  if (array == NULL)
+    return -1;
+  return seek(array, 0, 1);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_next
+ *
+ * DESCRIPTION:	    Returns the smallest index greater than `index' which
+ *		    holds an element.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    index: (long long) -- The index to search from. May be -1,
+ *			to search from 0.
+ *
+ * RETURN:	    long long -- The index, or -1 if there is none.
+ *
+ * NOTES:	    O(n/64) in the distance to the element, as for
+ *		    darray_min(). Safe to call concurrently with writers of a
+ *		    concurrent array, though an element being written may be
+ *		    missed.
+ ***/
+long long darray_next(darray * array, long long index)
+{
+  if (array == NULL || index >= DARRAY_INDEX_MAX)
+    return -1;
+  return seek(array, index < 0 ? 0 : index + 1, 1);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_prev
+ *
+ * DESCRIPTION:	    Returns the largest index less than `index' which holds
+ *		    an element.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    index: (long long) -- The index to search from.
+ *
+ * RETURN:	    long long -- The index, or -1 if there is none.
+ *
+ * NOTES:	    O(n/64) in the distance to the element, as for
+ *		    darray_next().
+ ***/
+long long darray_prev(darray * array, long long index)
+{
+  if (array == NULL || index <= 0)
+    return -1;
+  return seek(array, index - 1, 0);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_stats
+ *
+ * DESCRIPTION:	    Copies the counters kept by the array into `out', and fills
+ *		    in the memory it holds: the bytes of its header, landings
+ *		    and pages, the slots in them, and the slots in use.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    out: (darray_statistics *) -- Receives the statistics.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(landings), or O(pages) for a sparse array. Without
+ *		    CONFIG_DARRAY_STATS, every counter reads 0. Safe to call
+ *		    concurrently with writers of a concurrent array, though
+ *		    the figures need not be consistent with one another.
+ ***/
+int darray_stats(darray * array, darray_statistics * out)
+{
+  if (array == NULL || out == NULL)
+    return -1;
+
+  memset(out, 0, sizeof(darray_statistics));
+#ifdef CONFIG_DARRAY_STATS
+#   define Read(field)							\
+  (out->field = __atomic_load_n(&array->stats.field, __ATOMIC_RELAXED))
+  Read(gets);
+  Read(sets);
+  Read(cursor_hits);
+  Read(cursor_misses);
+  Read(walked);
+  Read(landings_allocated);
+  Read(landings_freed);
+  Read(pages_allocated);
+  Read(pages_freed);
+#   undef Read
+#endif
+
+  out->bytes = sizeof(darray) + (Near(array) ? 0 : DirectoryBytes);
+  int landings = __atomic_load_n(&array->landings, __ATOMIC_ACQUIRE);
+  for (int n = 0; n < landings; n++) {
+    void ** l = __atomic_load_n(&array->landing[n], __ATOMIC_ACQUIRE);
+    if (l == NULL)
+      continue;
+
+    /* The header already counts a landing held within it */
+    if (l != (void **)array->local)
+      out->bytes += Bytes(array, n);
+    if (!Paged(array, n)) {
+      out->slots += darray_landing_size(array, n);
+      continue;
+    }
+    for (size_t p = 0; p < Pages(array, n); p++) {
+      if (l[p] != NULL) {
+	out->bytes += PageBytes(array);
+	out->slots += 1ll << array->pshift;
+      }
+    }
+  }
+
+  out->used = darray_size(array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_fini
+ *
+ * DESCRIPTION:	    Releases the landings of an array initialized with
+ *		    darray_init(), calling the destroy function on each
+ *		    non-empty element, but not the structure itself.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to release.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(n). The structure may be initialized again afterwards.
+ ***/
+void darray_fini(darray * array)
+{
+  if (array == NULL)
+    return;
+  reclaim(array, SIZE_MAX);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_stats_reset
+ *
+ * DESCRIPTION:	    Sets every counter kept by the array back to zero.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1). Does nothing without CONFIG_DARRAY_STATS.
+ ***/
+void darray_stats_reset(darray * array)
+{
+#ifdef CONFIG_DARRAY_STATS
+  if (array == NULL)
+    return;
+
+#   define Reset(field)						\
+  __atomic_store_n(&array->stats.field, 0, __ATOMIC_RELAXED)
+  Reset(gets);
+  Reset(sets);
+  Reset(cursor_hits);
+  Reset(cursor_misses);
+  Reset(walked);
+  Reset(landings_allocated);
+  Reset(landings_freed);
+  Reset(pages_allocated);
+  Reset(pages_freed);
+#   undef Reset
+#else
+  (void)array;
+#endif
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_destroy
+ *
+ * DESCRIPTION:	    This function frees all memory which has been internally
+ *		    associated with the array. If a function was passed to the
+ *		    function darray_create() when the list was created, this
+ *		    function will invoke it on all non-NULL entries in the
+ *		    array. This is useful, for instance, in freeing user memory
+ *		    when it is no longer needed, or notifying a structure of an
+ *		    event. Please note that the user function will be called on
+ *		    ONLY the non-NULL elements in the array. This is to
+ *		    mitigate the time spent inside of this function.
+ *
+ * ARGUMENTS:	    array: (darray **) -- Pointer to the array to destroy.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(n) up to darray_largest() if there is a user function,
+ *		    or O(landings) if there is none.
+ ***/
+void darray_destroy(darray ** array)
+{
+  if (array == NULL || *array == NULL)
+    return;
+
+  reclaim(*array, SIZE_MAX);
+  *array = NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_destroy_step
+ *
+ * DESCRIPTION:	    Performs a bounded amount of the work of darray_destroy(),
+ *		    for callers (e.g. event loops) which cannot afford to
+ *		    destroy a large array all at once. Once the first step has
+ *		    been taken, the array may only be passed to further calls
+ *		    of this function.
+ *
+ * ARGUMENTS:	    array: (darray **) -- Pointer to the array to destroy.
+ *		    budget: (size_t) -- The number of slots to visit in this
+ *			step. Freeing a landing counts as one slot.
+ *
+ * RETURN:	    int -- 1 if there is more work to do, or 0 if the array has
+ *		    been destroyed and *array set to NULL.
+ *
+ * NOTES:	    O(budget)
+ ***/
+int darray_destroy_step(darray ** array, size_t budget)
+{
+  if (array == NULL || *array == NULL)
+    return 0;
+
+  if (reclaim(*array, budget == 0 ? 1 : budget))
+    return 1;
+  *array = NULL;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_destroy_async
+ *
+ * DESCRIPTION:	    Detaches the array from the caller, and destroys it on a
+ *		    background thread, so that the caller does not stall on a
+ *		    large array. The destroy function, if any, is called on
+ *		    that thread.
+ *
+ * ARGUMENTS:	    array: (darray **) -- Pointer to the array to destroy.
+ *
+ * RETURN:	    int -- 0 if the array was handed off and *array set to
+ *		    NULL, -1 if no thread could be started, in which case the
+ *		    array is untouched.
+ *
+ * NOTES:	    O(1) for the caller. Work still in progress when the
+ *		    process exits is abandoned.
+ ***/
+int darray_destroy_async(darray ** array)
+{
+  if (array == NULL || *array == NULL)
+    return 0;
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr))
+    return -1;
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int ret = pthread_create(&thread, &attr, reclaim_main, *array);
+  pthread_attr_destroy(&attr);
+  if (ret)
+    return -1;
+
+  *array = NULL;
+  return 0;
+}
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    stdlib_alloc
+ *
+ * DESCRIPTION:	    The alloc hook of darray_stdlib_allocator. Allocations of
+ *		    CONFIG_DARRAY_MMAP_THRESHOLD bytes or more are mapped.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * stdlib_alloc(void * ctx, size_t size)
+{
+  (void)ctx;
+  return Large(size) ? stdlib_map(size) : malloc(size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    stdlib_zalloc
+ *
+ * DESCRIPTION:	    The zalloc hook of darray_stdlib_allocator. A mapping is
+ *		    zero already, and none of it is touched until it is used.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the zeroed memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * stdlib_zalloc(void * ctx, size_t size)
+{
+  (void)ctx;
+  return Large(size) ? stdlib_map(size) : calloc(1, size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    stdlib_free
+ *
+ * DESCRIPTION:	    The free hook of darray_stdlib_allocator. The size given
+ *		    tells whether the memory was mapped.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    ptr: (void *) -- The memory to free.
+ *		    size: (size_t) -- The size it was allocated with.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void stdlib_free(void * ctx, void * ptr, size_t size)
+{
+  (void)ctx;
+  if (Large(size))
+    munmap(ptr, size);
+  else
+    free(ptr);
+}
+
+/******************************************************************************
+ * FUNCTION:	    stdlib_map
+ *
+ * DESCRIPTION:	    Maps `size' bytes of anonymous memory, asking for
+ *		    transparent huge pages if CONFIG_DARRAY_HUGEPAGES is
+ *		    defined.
+ *
+ * ARGUMENTS:	    size: (size_t) -- The number of bytes to map.
+ *
+ * RETURN:	    void * -- Pointer to the zeroed memory, or NULL.
+ *
+ * NOTES:	    The kernel zeroes each page when it is first touched.
+ ***/
+static void * stdlib_map(size_t size)
+{
+  void * ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    return NULL;
+#if defined(CONFIG_DARRAY_HUGEPAGES) && defined(MADV_HUGEPAGE)
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  return ptr;
+}
+
+/******************************************************************************
+ * FUNCTION:	    landing_of
+ *
+ * DESCRIPTION:	    Returns the number of the landing holding `index'. With a
+ *		    first landing of F = 2^fshift slots and a growth factor of
+ *		    G = 2^gshift, landing n starts at F * (G^n - 1) / (G - 1),
+ *		    so the landing of x is floor(log_G(x / F * (G - 1) + 1)).
+ *
+ * ARGUMENTS:	    array: (const darray *) -- The array in question.
+ *		    index: (long long) -- The index. Must be between 0 and
+ *			DARRAY_INDEX_MAX.
+ *
+ * RETURN:	    int -- The landing number.
+ *
+ * NOTES:	    O(1). The common case of G = 2 is a single clz. Since
+ *		    index < 2^47 and G <= 2^8, the product cannot overflow.
+ ***/
+static inline int landing_of(const darray * array, long long index)
+{
+  unsigned long long x = (unsigned long long)index >> array->fshift;
+  if (array->gshift == 1)
+    return 63 - __builtin_clzll(x + 1);
+
+  unsigned long long t = x * ((1ull << array->gshift) - 1) + 1;
+  return (63 - __builtin_clzll(t)) / array->gshift;
+}
+
+/******************************************************************************
+ * FUNCTION:	    landing_start
+ *
+ * DESCRIPTION:	    Returns the first index held by landing `num'.
+ *
+ * ARGUMENTS:	    array: (const darray *) -- The array in question.
+ *		    num: (int) -- The landing number.
+ *
+ * RETURN:	    long long -- The first index held by the landing.
+ *
+ * NOTES:	    O(1)
+ ***/
+static inline long long landing_start(const darray * array, int num)
+{
+  if (array->gshift == 1)
+    return ((1ll << num) - 1) << array->fshift;
+
+  return (((1ll << (array->gshift * num)) - 1)
+	  / ((1ll << array->gshift) - 1)) << array->fshift;
+}
+
+/******************************************************************************
+ * FUNCTION:	    valid_config
+ *
+ * DESCRIPTION:	    Checks a configuration for darray_create_ex() or
+ *		    darray_init().
+ *
+ * ARGUMENTS:	    config: (const darray_config *) -- The configuration.
+ *
+ * RETURN:	    int -- non-zero if the configuration is valid.
+ *
+ * NOTES:	    O(1)
+ ***/
+static int valid_config(const darray_config * config)
+{
+  if (config->first <= 0 || config->first > (1 << 24)
+      || (config->first & (config->first - 1)) != 0
+      || config->shift < 1 || config->shift > 8 || config->spare < 0)
+    return 0;
+  if (config->elsize > ((size_t)1 << 16)
+      || (config->elsize != 0 && config->concurrent))
+    return 0;
+  if (config->page < 0 || config->page > (1 << 24)
+      || (config->page & (config->page - 1)) != 0
+      || (config->page != 0 && config->concurrent))
+    return 0;
+  return 1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    configure
+ *
+ * DESCRIPTION:	    Initializes an empty array from a valid configuration.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The structure to initialize.
+ *		    config: (const darray_config *) -- The configuration.
+ *		    allocator: (const darray_allocator *) -- The allocator.
+ *		    embedded: (int) -- non-zero if the caller owns the
+ *			structure.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1)
+ ***/
+static void configure(darray * array, const darray_config * config,
+		      const darray_allocator * allocator, int embedded)
+{
+  *array = (darray){
+    .landing = array->directory,
+    .size = 0,
+    .largest = 0,
+    .landings = 0,
+    .spare = config->spare,
+    .fshift = __builtin_ctz((unsigned)config->first),
+    .gshift = config->shift,
+    .elsize = config->elsize != 0 ? config->elsize : sizeof(void *),
+    .values = config->elsize != 0,
+    .concurrent = config->concurrent != 0,
+    .sparse = config->page != 0,
+    .pshift = config->page != 0 ? __builtin_ctz((unsigned)config->page) : 0,
+    .untracked = 0,
+    .shared = 0,
+    .mapped = 0,
+    .readonly = 0,
+    .carved = 0,
+    .block = NULL,
+    .allocator = allocator,
+    .destroy = config->destroy,
+    .embedded = embedded,
+    .local = {0},
+    .directory = {NULL}
+  };
+}
+
+/******************************************************************************
+ * FUNCTION:	    widen
+ *
+ * DESCRIPTION:	    Makes room in the landing directory for landing `num',
+ *		    moving the directory out of the header into an allocation
+ *		    of DARRAY_MAX_LANDINGS entries once it outgrows it.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    num: (int) -- The landing number, below
+ *			DARRAY_MAX_LANDINGS.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(1). The directory only moves once, and never for a
+ *		    concurrent array, whose directory is allocated with it.
+ ***/
+static int widen(darray * array, int num)
+{
+  if (num < Capacity(array))
+    return 0;
+
+  void *** dir = NULL;
+  if ((dir = array->allocator->zalloc(array->allocator->ctx,
+				      DirectoryBytes)) == NULL)
+    return -1;
+  memcpy(dir, array->directory, sizeof(array->directory));
+  array->landing = dir;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    carve
+ *
+ * DESCRIPTION:	    Allocates landings 0 through needed - 1 for
+ *		    darray_reserve(), carving those not yet allocated from a
+ *		    single block. The first landing, if it fits in the header,
+ *		    and the page tables of paged landings are allocated as
+ *		    usual.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question, which holds
+ *			no carved landings.
+ *		    needed: (int) -- The number of landings to allocate.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(needed)
+ ***/
+static int carve(darray * array, int needed)
+{
+  /* Allocate whatever is not carved first, since it may fail */
+  if (widen(array, needed - 1))
+    return -1;
+  int local = Bytes(array, 0) <= sizeof(array->local);
+  for (int k = 0; k < needed; k++) {
+    if (array->landing[k] == NULL && (Paged(array, k) || (k == 0 && local))
+	&& get_landing(array, k, 1) == NULL)
+      return -1;
+  }
+
+  size_t bytes = Piece(sizeof(struct darray_block));
+  long long pieces = 0;
+  for (int k = 0; k < needed; k++) {
+    if (array->landing[k] == NULL) {
+      bytes += Piece(Bytes(array, k));
+      pieces++;
+    }
+  }
+  if (pieces == 0)
+    return 0;
+
+  struct darray_block * block = NULL;
+  if ((block = array->allocator->zalloc(array->allocator->ctx, bytes)) == NULL)
+    return -1;
+  *block = (struct darray_block){
+    .live = pieces,
+    .pieces = pieces,
+    .bytes = bytes
+  };
+
+  char * at = (char *)block + Piece(sizeof(struct darray_block));
+  for (int k = 0; k < needed; k++) {
+    if (array->landing[k] == NULL) {
+      array->landing[k] = (void **)at;
+      array->carved |= 1ull << k;
+      at += Piece(Bytes(array, k));
+      Count(array, landings_allocated, 1);
+    }
+  }
+  array->block = block;
+  if (array->landings < needed)
+    array->landings = needed;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    new_landing
+ *
+ * DESCRIPTION:	    Returns zeroed memory for landing `num' (or for its page
+ *		    table, if it is paged): the storage within the header for
+ *		    the first landing, if it fits, or else a fresh allocation.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    num: (int) -- The landing number.
+ *
+ * RETURN:	    void ** -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    O(1). The storage within the header is zeroed whenever its
+ *		    landing is freed, so it can be handed out again.
+ ***/
+static void ** new_landing(darray * array, int num)
+{
+  if (num == 0 && Bytes(array, 0) <= sizeof(array->local))
+    return (void **)array->local;
+  return array->allocator->zalloc(array->allocator->ctx, Bytes(array, num));
+}
+
+/******************************************************************************
+ * FUNCTION:	    get_landing
+ *
+ * DESCRIPTION:	    Returns a pointer to the landing specified, optionally
+ *		    expanding the array on the way up, if necessary. A sparse
+ *		    array allocates only the landing specified, and for a
+ *		    paged landing, only its page table.
+ *
+ * ARGUMENTS:	    array: (darray *) -- pointer to the array we're searching.
+ *		    index: (int) -- The nth landing in the array.
+ *		    expand: (int) -- non-zero if we are allowed to expand.
+ *
+ * RETURN:	    void ** -- Pointer to the landing, or NULL.
+ *
+ * NOTES:	    O(1) - a single lookup in the landing directory.
+ ***/
+static void ** get_landing(darray * array, int index, int expand)
+{
+  if (index < array->landings
+      && (array->landing[index] != NULL || !array->sparse))
+    return array->landing[index];
+  if (!expand)
+    return NULL;
+
+  /* Expand the array if we are allowed to, and need to */
+  if (!array->sparse) {
+    if (expand_list(array, index - array->landings))
+      return NULL;
+    return array->landing[index];
+  }
+
+  void ** l = NULL;
+  if (widen(array, index) || (l = new_landing(array, index)) == NULL)
+    return NULL;
+  Count(array, landings_allocated, 1);
+  array->landing[index] = l;
+  if (index >= array->landings)
+    array->landings = index + 1;
+  return l;
+}
+
+/******************************************************************************
+ * FUNCTION:	    expand_list
+ *
+ * DESCRIPTION:	    Expands the array by `i' + 1 landings.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to expand.
+ *		    i: (int) -- The number of landings to add to the array,
+ *			less one.
+ *
+ * RETURN:	    int -- 0 on success, -1 on failure.
+ *
+ * NOTES:	    O(1)
+ ***/
+static int expand_list(darray * array, int i)
+{
+  if (i < 0 || array->landings + i >= DARRAY_MAX_LANDINGS
+      || widen(array, array->landings + i))
+    return -1;
+
+  void ** data = NULL;
+  while (i-- >= 0) {
+    if ((data = new_landing(array, array->landings)) == NULL)
+      return -1;
+    Count(array, landings_allocated, 1);
+    array->landing[array->landings++] = data;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    locate
+ *
+ * DESCRIPTION:	    Returns the address of the slot holding `index', along
+ *		    with the bounds of the run of slots which are contiguous
+ *		    with it: its landing, or its page in a paged landing. If
+ *		    the slot has not been allocated, the bounds are those of
+ *		    the run which would hold it.
+ *
+ * ARGUMENTS:	    array: (darray *) -- pointer to the array we're searching.
+ *		    index: (long long) -- The index. Must be >= 0.
+ *		    expand: (int) -- non-zero if we are allowed to allocate
+ *			the landing and page holding `index'.
+ *		    first: (long long *) -- Receives the first index of the run.
+ *		    end: (long long *) -- Receives one past the last index of
+ *			the run.
+ *
+ * RETURN:	    void * -- Pointer to the slot, or NULL.
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
+ ***/
+static void * locate(darray * array, long long index, int expand,
+		     long long * first, long long * end)
+{
+  int num = Calculate(array, index);
+  void ** l = get_landing(array, num, expand);
+  *first = landing_start(array, num);
+  *end = End(array, num);
+  if (l == NULL || !Paged(array, num))
+    return l == NULL ? NULL : Slot(array, l, index - *first);
+
+  /* Narrow the run to the page, allocating it if necessary */
+  long long off = index - *first;
+  void ** page = &l[off >> array->pshift];
+  *first += off >> array->pshift << array->pshift;
+  *end = *first + (1ll << array->pshift);
+  if (*page == NULL && expand) {
+    if ((*page = array->allocator->zalloc(array->allocator->ctx,
+					  PageBytes(array))) != NULL)
+      Count(array, pages_allocated, 1);
+  }
+  if (*page == NULL)
+    return NULL;
+  return Slot(array, *page, index - *first);
+}
+
+/******************************************************************************
+ * FUNCTION:	    free_landing
+ *
+ * DESCRIPTION:	    Frees landing `num' and, if it is paged, its pages. The
+ *		    landing may be NULL in a sparse array.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    num: (int) -- The landing number.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1), or O(pages) for a paged landing.
+ ***/
+static void free_landing(darray * array, int num)
+{
+  void ** l = array->landing[num];
+  if (l == NULL)
+    return;
+
+  int shared = Shared(array, num);
+  if (Paged(array, num)) {
+    for (size_t p = 0; p < Pages(array, num); p++) {
+      if (l[p] != NULL) {
+	drop(array, l[p], 1ll << array->pshift, shared, 0);
+	Count(array, pages_freed, 1);
+      }
+    }
+    Free(array, l, Bytes(array, num));
+  } else if (l == (void **)array->local) {
+    memset(array->local, 0, sizeof(array->local));
+  } else {
+    drop(array, l, darray_landing_size(array, num), shared, Carved(array, num));
+  }
+  Count(array, landings_freed, 1);
+  array->landing[num] = NULL;
+  array->untracked &= ~(1ull << num);
+  array->shared &= ~(1ull << num);
+  if ((array->carved &= ~(1ull << num)) == 0)
+    array->block = NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    missing
+ *
+ * DESCRIPTION:	    Returns a mask of the landings below array->landings which
+ *		    have not been allocated, as in a sparse array, for
+ *		    unwind().
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *
+ * RETURN:	    unsigned long long -- Bit n is set if landing n is NULL.
+ *
+ * NOTES:	    O(landings)
+ ***/
+static unsigned long long missing(darray * array)
+{
+  unsigned long long mask = 0;
+  for (int num = 0; array->sparse && num < array->landings; num++) {
+    if (array->landing[num] == NULL)
+      mask |= 1ull << num;
+  }
+  return mask;
+}
+
+/******************************************************************************
+ * FUNCTION:	    unwind
+ *
+ * DESCRIPTION:	    Frees the landings allocated by a bulk operation which
+ *		    failed part of the way through, and moves the landing
+ *		    directory back into the header if it was moved out.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    landings: (int) -- array->landings before the operation.
+ *		    fresh: (unsigned long long) -- missing() before the
+ *			operation.
+ *		    near: (int) -- Near() before the operation.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(landings). Pages allocated within landings which already
+ *		    existed are kept, since they hold no elements.
+ ***/
+static void unwind(darray * array, int landings, unsigned long long fresh,
+		   int near)
+{
+  for (int num = 0; num < array->landings; num++) {
+    if (num >= landings || (fresh >> num & 1))
+      free_landing(array, num);
+  }
+  array->landings = landings;
+  if (near && !Near(array)) {
+    memcpy(array->directory, array->landing, sizeof(array->directory));
+    Free(array, array->landing, DirectoryBytes);
+    array->landing = array->directory;
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    drop
+ *
+ * DESCRIPTION:	    Releases a run of slots: frees it, unless it is shared
+ *		    with another array, in which case its share count is
+ *		    decremented and the last array holding it frees it. A
+ *		    landing carved from a block frees the block along with
+ *		    the last piece of it.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    run: (void *) -- The first slot of the run.
+ *		    slots: (long long) -- The number of slots in the run.
+ *		    shared: (int) -- non-zero if the run may be shared. The
+ *			share count of any other run may not be read, since
+ *			runs within a mapped file have none.
+ *		    carved: (int) -- non-zero if the run was carved from the
+ *			block of the array.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1)
+ ***/
+static void drop(darray * array, void * run, long long slots, int shared,
+		 int carved)
+{
+  if (shared
+      && __atomic_fetch_sub(Refs(array, run, slots), 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  struct darray_block * block = array->block;
+  if (!carved)
+    Free(array, run, RunBytes(array, slots));
+  else if (__atomic_sub_fetch(&block->live, 1, __ATOMIC_ACQ_REL) == 0)
+    Free(array, block, block->bytes);
+}
+
+/******************************************************************************
+ * FUNCTION:	    own
+ *
+ * DESCRIPTION:	    Makes the run holding `index' private to the array before
+ *		    it is written, copying it if it is still shared with a
+ *		    clone. A run which has not been allocated is left alone.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (long long) -- The index about to be written.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if the copy could not be
+ *		    allocated.
+ *
+ * NOTES:	    O(1), or O(slots in the run) when it is copied. Once the
+ *		    other arrays have dropped a run, it is written in place.
+ ***/
+static int own(darray * array, long long index)
+{
+  int num = Calculate(array, index);
+  if (!Shared(array, num) || array->landing[num] == NULL)
+    return 0;
+  void ** l = array->landing[num];
+
+  int paged = Paged(array, num);
+  size_t page = (index - landing_start(array, num)) >> array->pshift;
+  long long slots = paged ? 1ll << array->pshift
+    : (long long)darray_landing_size(array, num);
+  void * run = paged ? l[page] : (void *)l;
+  if (run != NULL
+      && __atomic_load_n(Refs(array, run, slots), __ATOMIC_ACQUIRE) > 0) {
+    void * copy = NULL;
+    size_t bytes = RunBytes(array, slots);
+    if ((copy = array->allocator->alloc(array->allocator->ctx, bytes)) == NULL)
+      return -1;
+    memcpy(copy, run, bytes);
+    *Refs(array, copy, slots) = 0;
+    drop(array, run, slots, 1, !paged && Carved(array, num));
+
+    if (paged) {
+      l[page] = copy;
+      Count(array, pages_allocated, 1);
+      Count(array, pages_freed, 1);
+    } else {
+      array->landing[num] = copy;
+      if ((array->carved &= ~(1ull << num)) == 0)
+	array->block = NULL;
+      Count(array, landings_allocated, 1);
+      Count(array, landings_freed, 1);
+    }
+  }
+
+  /* The pages of a paged landing are owned one at a time */
+  if (!paged)
+    array->shared &= ~(1ull << num);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    get_one
+ *
+ * DESCRIPTION:	    Returns the user field stored at `index'. Shared by
+ *		    darray_get and darray_get64.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    index: (long long) -- Index desired.
+ *
+ * RETURN:	    void * -- Pointer to the user field.
+ *
+ * NOTES:	    O(1). Safe to call concurrently with darray_set(),
+ *		    darray_push(), darray_exchange() and darray_cas() on a
+ *		    concurrent array.
+ ***/
+static inline void * get_one(darray * array, long long index)
+{
+  if (array == NULL || array->values)
+    return NULL;
+  Count(array, gets, 1);
+  if (index < 0
+      || index > __atomic_load_n(&array->largest, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  /* Get the number of and a pointer to the landing. The acquire loads cost
+   * nothing on most targets, and allow readers of a concurrent array to run
+   * without a lock.
+   */
+  int num = Calculate(array, index);
+  void ** l = __atomic_load_n(&array->landing[num], __ATOMIC_ACQUIRE);
+  if (l == NULL)
+    return NULL;
+
+  long long off = Index(array, index, num);
+  if (Paged(array, num)) {
+    if ((l = l[(size_t)off >> array->pshift]) == NULL)
+      return NULL;
+    off &= (1ll << array->pshift) - 1;
+  }
+  return __atomic_load_n(&l[off], __ATOMIC_ACQUIRE);
+}
+
+/******************************************************************************
+ * FUNCTION:	    set_one
+ *
+ * DESCRIPTION:	    Sets the element at the index `index' in `array' to be the
+ *		    pointer `data'. Shared by darray_set, darray_set64 and
+ *		    darray_set_many.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (long long) -- The index in the array. Must be
+ *			between 0 and DARRAY_INDEX_MAX.
+ *		    data: (void *) -- The data to populate the array with.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings.
+ ***/
+static inline int set_one(darray * array, long long index, void * data)
+{
+  Count(array, sets, 1);
+  if (array->concurrent) {
+    void * old = NULL;
+    return swap_slot(array, index, data, &old, 0);
+  }
+
+  /* This isn't an error...but we don't have to do anything if it's true */
+  if (index > array->largest && data == NULL)
+    return 0;
+  if (array->shared != 0 && own(array, index))
+    return -1;
+
+  /* Get a pointer to the slot, and the run holding it */
+  long long first = 0, end = 0;
+  void ** slot = locate(array, index, data != NULL, &first, &end);
+  if (slot == NULL)
+    return data == NULL ? 0 : -1;
+
+  if ((*slot == NULL) != (data == NULL)) {
+    array->size += data != NULL ? 1 : -1;
+    track(array, index, slot, first, end, data != NULL);
+  }
+  *slot = data;
+
+  if (index > array->largest)
+    array->largest = index;
+  else if (index == array->largest && data == NULL)
+    settle_largest(array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    next_index
+ *
+ * DESCRIPTION:	    Returns the index at which darray_push() appends: the one
+ *		    following darray_largest(), or 0 if the array is empty.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *
+ * RETURN:	    long long -- The index, or -1 if the array is full.
+ *
+ * NOTES:	    O(1)
+ ***/
+static long long next_index(darray * array)
+{
+  if (array->size == 0)
+    return 0;
+  return array->largest >= DARRAY_INDEX_MAX ? -1 : array->largest + 1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    publish_landing
+ *
+ * DESCRIPTION:	    Returns a pointer to the landing specified, optionally
+ *		    allocating it (and every landing before it) on the way.
+ *		    Each new landing is published with a CAS, so several
+ *		    threads may expand a concurrent array at once. The loser
+ *		    of a race frees its landing and uses the winner's.
+ *
+ * ARGUMENTS:	    array: (darray *) -- pointer to the array we're searching.
+ *		    num: (int) -- The nth landing in the array.
+ *		    expand: (int) -- non-zero if we are allowed to expand.
+ *
+ * RETURN:	    void ** -- Pointer to the landing, or NULL.
+ *
+ * NOTES:	    O(1). The allocator must be thread-safe.
+ ***/
+static void ** publish_landing(darray * array, int num, int expand)
+{
+  void ** l = __atomic_load_n(&array->landing[num], __ATOMIC_ACQUIRE);
+  if (l != NULL || !expand)
+    return l;
+
+  /* Landings are published in order, so that landing[n] != NULL implies
+   * the same for every landing before it.
+   */
+  for (int k = 0; k <= num; k++) {
+    if (__atomic_load_n(&array->landing[k], __ATOMIC_ACQUIRE) != NULL)
+      continue;
+
+    /* The loser of a race for the first landing held within the header
+     * leaves it alone, as the winner may already be writing to it.
+     */
+    void ** fresh = NULL;
+    if ((fresh = new_landing(array, k)) == NULL)
+      return NULL;
+    void ** expected = NULL;
+    if (!__atomic_compare_exchange_n(&array->landing[k], &expected, fresh, 0,
+				     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      if (fresh != (void **)array->local)
+	Free(array, fresh, Bytes(array, k));
+    } else {
+      Count(array, landings_allocated, 1);
+    }
+
+    int count = __atomic_load_n(&array->landings, __ATOMIC_RELAXED);
+    while (count < k + 1
+	   && !__atomic_compare_exchange_n(&array->landings, &count, k + 1, 1,
+					   __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+
+  return __atomic_load_n(&array->landing[num], __ATOMIC_ACQUIRE);
+}
+
+/******************************************************************************
+ * FUNCTION:	    swap_slot
+ *
+ * DESCRIPTION:	    Atomically replaces the element at `index' with `data',
+ *		    either unconditionally, or only if it holds *old, and
+ *		    updates the size and largest index of the array.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    index: (long long) -- The index in the array. Must be
+ *			between 0 and DARRAY_INDEX_MAX.
+ *		    data: (void *) -- The data to populate the array with.
+ *		    old: (void **) -- Receives the previous element. If `cas'
+ *			is non-zero, holds the expected element on entry.
+ *		    cas: (int) -- non-zero for a compare-and-swap.
+ *
+ * RETURN:	    int -- 0 if successful, 1 if the element did not hold the
+ *		    expected value, -1 if something bad happened.
+ *
+ * NOTES:	    O(1), plus the cost of allocating any new landings. On a
+ *		    concurrent array, largest never moves down and landings
+ *		    are never released, since readers may be using them.
+ ***/
+static int swap_slot(darray * array, long long index, void * data,
+		     void ** old, int cas)
+{
+  int num = Calculate(array, index);
+  long long first = 0, end = 0;
+  void ** slot = NULL;
+  if (array->concurrent) {
+    void ** l = publish_landing(array, num, data != NULL);
+    slot = l == NULL ? NULL : l + Index(array, index, num);
+    first = landing_start(array, num);
+    end = End(array, num);
+  } else {
+    if (array->shared != 0 && own(array, index))
+      return -1;
+    slot = locate(array, index, data != NULL, &first, &end);
+  }
+  if (slot == NULL) {
+    /* The slot has never been allocated, so it holds NULL */
+    if (data != NULL)
+      return -1;
+    int ret = cas && *old != NULL;
+    *old = NULL;
+    return ret;
+  }
+
+  if (cas) {
+    if (!__atomic_compare_exchange_n(slot, old, data, 0, __ATOMIC_ACQ_REL,
+				     __ATOMIC_ACQUIRE))
+      return 1;
+  } else {
+    *old = __atomic_exchange_n(slot, data, __ATOMIC_ACQ_REL);
+  }
+
+  int delta = (*old == NULL) - (data == NULL);
+  if (delta != 0)
+    track(array, index, slot, first, end, data != NULL);
+  if (array->concurrent) {
+    if (delta != 0)
+      __atomic_fetch_add(&array->size, delta, __ATOMIC_RELAXED);
+    if (data != NULL)
+      raise_to(&array->largest, index);
+    return 0;
+  }
+
+  array->size += delta;
+  if (data != NULL && index > array->largest)
+    array->largest = index;
+  else if (data == NULL && index == array->largest)
+    settle_largest(array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    push_atomic
+ *
+ * DESCRIPTION:	    darray_push() for concurrent arrays. The index following
+ *		    largest is claimed with a CAS from NULL; if another thread
+ *		    got there first, the next index is tried.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array we would like to mutate.
+ *		    data: (void *) -- The data to append. Must be non-NULL.
+ *
+ * RETURN:	    int -- The index of the new element, or -1 if something bad
+ *		    happened.
+ *
+ * NOTES:	    Lock-free.
+ ***/
+static int push_atomic(darray * array, void * data)
+{
+  long long index = 0;
+  for (;;) {
+    if (__atomic_load_n(&array->size, __ATOMIC_RELAXED) != 0) {
+      long long largest = __atomic_load_n(&array->largest, __ATOMIC_ACQUIRE);
+      if (largest + 1 > index)
+	index = largest + 1;
+    }
+    if (index > INT_MAX)
+      return -1;
+
+    void * expected = NULL;
+    int ret = swap_slot(array, index, data, &expected, 1);
+    if (ret <= 0)
+      return ret == 0 ? (int)index : -1;
+    index++;
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    raise_to
+ *
+ * DESCRIPTION:	    Atomically raises *value to `to', if it is smaller.
+ *
+ * ARGUMENTS:	    value: (long long *) -- The value to raise.
+ *		    to: (long long) -- The new minimum.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    The store has release semantics, so that a reader which
+ *		    observes the new value also observes what preceded it.
+ ***/
+static inline void raise_to(long long * value, long long to)
+{
+  long long cur = __atomic_load_n(value, __ATOMIC_RELAXED);
+  while (cur < to
+	 && !__atomic_compare_exchange_n(value, &cur, to, 1, __ATOMIC_RELEASE,
+					 __ATOMIC_RELAXED))
+    ;
+}
+
+/******************************************************************************
+ * FUNCTION:	    slot_empty
+ *
+ * DESCRIPTION:	    Determines whether an element is empty. An element is
+ *		    empty when all of its bytes are zero, which for pointer
+ *		    arrays is the same as being NULL.
+ *
+ * ARGUMENTS:	    array: (const darray *) -- The array in question.
+ *		    slot: (const void *) -- Pointer to the element.
+ *
+ * RETURN:	    int -- non-zero if the element is empty.
+ *
+ * NOTES:	    O(elsize)
+ ***/
+static inline int slot_empty(const darray * array, const void * slot)
+{
+  if (array->elsize == sizeof(void *)) {
+    void * p;
+    memcpy(&p, slot, sizeof(void *));
+    return p == NULL;
+  }
+
+  const unsigned char * bytes = (const unsigned char *)slot;
+  for (size_t i = 0; i < array->elsize; i++) {
+    if (bytes[i] != 0)
+      return 0;
+  }
+  return 1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    track
+ *
+ * DESCRIPTION:	    Records in the occupancy bitmap that the slot holding
+ *		    `index' has been filled, or emptied. In a concurrent array,
+ *		    bits are only ever set: a racing writer may have filled the
+ *		    slot again, so a set bit only means the slot may be full.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    index: (long long) -- The index of the slot.
+ *		    slot: (void *) -- The address of the slot.
+ *		    first: (long long) -- The first index of the run holding
+ *			the slot, as reported by locate().
+ *		    end: (long long) -- One past the last index of the run.
+ *		    on: (int) -- non-zero if the slot has been filled.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1)
+ ***/
+static inline void track(darray * array, long long index, void * slot,
+			 long long first, long long end, int on)
+{
+  if (!Tracked(array, Calculate(array, index)))
+    return;
+
+  long long off = index - first;
+  void * run = (char *)slot - (size_t)off * array->elsize;
+  uint64_t * bits = Bitmap(array, run, end - first);
+  uint64_t * summary = Summary(array, run, end - first);
+  uint64_t bit = (uint64_t)1 << (off & 63);
+  uint64_t word = (uint64_t)1 << (off >> 6 & 63);
+  off >>= 6;
+
+  if (array->concurrent) {
+    if (on) {
+      __atomic_fetch_or(&bits[off], bit, __ATOMIC_RELAXED);
+      __atomic_fetch_or(&summary[off >> 6], word, __ATOMIC_RELAXED);
+    }
+  } else if (on) {
+    bits[off] |= bit;
+    summary[off >> 6] |= word;
+  } else if ((bits[off] &= ~bit) == 0) {
+    summary[off >> 6] &= ~word;
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    rebuild_bits
+ *
+ * DESCRIPTION:	    Rebuilds the occupancy bitmap and summary of a run from
+ *		    the slots themselves.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    run: (void *) -- The first slot of the run.
+ *		    slots: (long long) -- The number of slots in the run.
+ *
+ * RETURN:	    long long -- The number of slots which are not empty.
+ *
+ * NOTES:	    O(slots)
+ ***/
+static long long rebuild_bits(darray * array, void * run, long long slots)
+{
+  uint64_t * bits = Bitmap(array, run, slots);
+  uint64_t * summary = Summary(array, run, slots);
+  memset(bits, 0, (Words(slots) + Words(Words(slots))) * sizeof(uint64_t));
+
+  long long count = 0;
+  for (long long off = 0; off < slots; off++) {
+    if (!slot_empty(array, Slot(array, run, off))) {
+      bits[off >> 6] |= (uint64_t)1 << (off & 63);
+      summary[off >> 12] |= (uint64_t)1 << (off >> 6 & 63);
+      count++;
+    }
+  }
+  return count;
+}
+
+/******************************************************************************
+ * FUNCTION:	    bits_next
+ *
+ * DESCRIPTION:	    Finds the first set bit at or after `off' in the occupancy
+ *		    bitmap of a run, using the summary to skip empty words.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    run: (void *) -- The first slot of the run.
+ *		    slots: (long long) -- The number of slots in the run.
+ *		    off: (long long) -- The offset to search from, which must
+ *			be less than `slots'.
+ *
+ * RETURN:	    long long -- The offset of the bit, or -1 if there is none.
+ *
+ * NOTES:	    O(slots/4096) at worst.
+ ***/
+static long long bits_next(darray * array, void * run, long long slots,
+			   long long off)
+{
+  const uint64_t * bits = Bitmap(array, run, slots);
+  const uint64_t * summary = Summary(array, run, slots);
+  long long words = Words(slots), w = off >> 6;
+  uint64_t word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED)
+    & (~(uint64_t)0 << (off & 63));
+
+  while (word == 0) {
+    /* Find the next word which may be non-zero */
+    if (++w >= words)
+      return -1;
+    long long s = w >> 6;
+    uint64_t sum = __atomic_load_n(&summary[s], __ATOMIC_RELAXED)
+      & (~(uint64_t)0 << (w & 63));
+    while (sum == 0) {
+      if (++s >= (long long)Words(words))
+	return -1;
+      sum = __atomic_load_n(&summary[s], __ATOMIC_RELAXED);
+    }
+    w = s * 64 + __builtin_ctzll(sum);
+    word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED);
+  }
+
+  return w * 64 + __builtin_ctzll(word);
+}
+
+/******************************************************************************
+ * FUNCTION:	    bits_prev
+ *
+ * DESCRIPTION:	    Finds the last set bit at or before `off' in the occupancy
+ *		    bitmap of a run, using the summary to skip empty words.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    run: (void *) -- The first slot of the run.
+ *		    slots: (long long) -- The number of slots in the run.
+ *		    off: (long long) -- The offset to search from, which must
+ *			be less than `slots'.
+ *
+ * RETURN:	    long long -- The offset of the bit, or -1 if there is none.
+ *
+ * NOTES:	    O(slots/4096) at worst.
+ ***/
+static long long bits_prev(darray * array, void * run, long long slots,
+			   long long off)
+{
+  const uint64_t * bits = Bitmap(array, run, slots);
+  const uint64_t * summary = Summary(array, run, slots);
+  long long w = off >> 6;
+  uint64_t word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED)
+    & (~(uint64_t)0 >> (63 - (off & 63)));
+
+  while (word == 0) {
+    /* Find the previous word which may be non-zero */
+    if (--w < 0)
+      return -1;
+    long long s = w >> 6;
+    uint64_t sum = __atomic_load_n(&summary[s], __ATOMIC_RELAXED)
+      & (~(uint64_t)0 >> (63 - (w & 63)));
+    while (sum == 0) {
+      if (--s < 0)
+	return -1;
+      sum = __atomic_load_n(&summary[s], __ATOMIC_RELAXED);
+    }
+    w = s * 64 + 63 - __builtin_clzll(sum);
+    word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED);
+  }
+
+  return w * 64 + 63 - __builtin_clzll(word);
+}
+
+/******************************************************************************
+ * FUNCTION:	    seek
+ *
+ * DESCRIPTION:	    Finds the nearest index at or after (or at or before)
+ *		    `index' which holds an element, no further than
+ *		    darray_largest(). Runs which have not been allocated are
+ *		    skipped whole, and runs whose bitmaps are kept are searched
+ *		    a word at a time. Each candidate is checked against its
+ *		    slot, since a bit in a concurrent array may be stale.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array in question.
+ *		    index: (long long) -- The index to search from. Must be
+ *			>= 0.
+ *		    forward: (int) -- non-zero to search upwards.
+ *
+ * RETURN:	    long long -- The index, or -1 if there is none.
+ *
+ * NOTES:	    O(n/64) in the distance searched.
+ ***/
+static long long seek(darray * array, long long index, int forward)
+{
+  long long largest = __atomic_load_n(&array->largest, __ATOMIC_ACQUIRE);
+  if (index > largest) {
+    if (forward)
+      return -1;
+    index = largest;
+  }
+
+  long long first = 0, end = 0;
+  while (index >= 0 && index <= largest) {
+    Count(array, walked, 1);
+    int num = Calculate(array, index);
+    char * slot = NULL;
+    if (array->sparse) {
+      slot = locate(array, index, 0, &first, &end);
+    } else {
+      /* Readers of a concurrent array must load the landing atomically */
+      void ** l = __atomic_load_n(&array->landing[num], __ATOMIC_ACQUIRE);
+      first = landing_start(array, num);
+      end = End(array, num);
+      slot = l == NULL ? NULL : Slot(array, l, index - first);
+    }
+
+    if (slot != NULL) {
+      long long slots = end - first, off = index - first;
+      char * run = slot - (size_t)off * array->elsize;
+      int tracked = Tracked(array, num);
+      while (off >= 0 && off < slots) {
+	if (tracked && (off = forward ? bits_next(array, run, slots, off)
+			: bits_prev(array, run, slots, off)) < 0)
+	  break;
+	void * at = Slot(array, run, off);
+	if (array->concurrent
+	    ? __atomic_load_n((void **)at, __ATOMIC_ACQUIRE) != NULL
+	    : !slot_empty(array, at))
+	  return first + off <= largest ? first + off : -1;
+	off += forward ? 1 : -1;
+      }
+    }
+
+    index = forward ? end : first - 1;
+  }
+
+  return -1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    settle_largest
+ *
+ * DESCRIPTION:	    Moves array->largest down to the largest index which
+ *		    still holds a non-NULL element, or to 0, then releases the
+ *		    landings which are no longer needed.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to update.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(n/64) in the number of trailing NULL elements, or O(n)
+ *		    within landings whose bitmaps are not kept.
+ ***/
+static void settle_largest(darray * array)
+{
+  long long index = array->size == 0 ? -1 : seek(array, array->largest, 0);
+  array->largest = index < 0 ? 0 : index;
+  release_landings(array);
+}
+
+/******************************************************************************
+ * FUNCTION:	    release_landings
+ *
+ * DESCRIPTION:	    Frees the trailing landings which hold no elements, except
+ *		    for array->spare of them, and those reserved by
+ *		    darray_reserve(). Keeping spares means that an element
+ *		    oscillating across a landing boundary does not allocate
+ *		    and free a landing each time.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to contract.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(1). Never releases the landings of a concurrent array.
+ ***/
+static void release_landings(darray * array)
+{
+  /* Readers of a concurrent array may still be using any landing */
+  if (array->concurrent)
+    return;
+
+  int keep = array->size == 0 ? 0 : Calculate(array, array->largest) + 1;
+  keep += array->spare;
+  if (keep < array->reserved)
+    keep = array->reserved;
+
+  while (array->landings > keep)
+    free_landing(array, --array->landings);
+}
+
+/******************************************************************************
+ * FUNCTION:	    reclaim
+ *
+ * DESCRIPTION:	    Tears the array down from the top, calling the destroy
+ *		    function on each non-empty element and freeing each
+ *		    landing once it has been visited. The largest index and
+ *		    landing count record the progress, so the teardown may be
+ *		    spread over several calls.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to destroy.
+ *		    budget: (size_t) -- The number of slots to visit. Freeing
+ *			a landing counts as one slot.
+ *
+ * RETURN:	    int -- 1 if there is more work to do, or 0 if the array
+ *		    has been freed.
+ *
+ * NOTES:	    O(budget)
+ ***/
+static int reclaim(darray * array, size_t budget)
+{
+  while (budget > 0 && array->landings > 0) {
+    int n = array->landings - 1;
+    long long first = landing_start(array, n);
+
+    /* Slots above largest are empty, so only the rest need visiting */
+    if (array->destroy != NULL) {
+      long long index = array->largest;
+      long long from = 0, end = 0;
+      for (; budget > 0 && index >= first; budget--) {
+	void * slot = locate(array, index, 0, &from, &end);
+	if (slot == NULL) {
+	  index = from - 1;
+	  continue;
+	}
+	if (!slot_empty(array, slot))
+	  array->destroy(array->values ? slot : *(void **)slot);
+	index--;
+      }
+      array->largest = index;
+      if (index >= first)
+	return 1;
+    } else if (array->largest >= first) {
+      array->largest = first - 1;
+    }
+
+    if (budget == 0)
+      return 1;
+    free_landing(array, n);
+    array->landings--;
+    budget--;
+  }
+
+  if (array->landings > 0)
+    return 1;
+  if (!Near(array)) {
+    Free(array, array->landing, DirectoryBytes);
+    array->landing = array->directory;
+  }
+  if (!array->embedded)
+    Free(array, array, sizeof(darray));
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    reclaim_main
+ *
+ * DESCRIPTION:	    The body of the thread started by darray_destroy_async().
+ *
+ * ARGUMENTS:	    arg: (void *) -- The array to destroy.
+ *
+ * RETURN:	    void * -- NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * reclaim_main(void * arg)
+{
+  reclaim((darray *)arg, SIZE_MAX);
+  return NULL;
+}
+
+#ifdef CONFIG_DARRAY_AVX2
+/******************************************************************************
+ * FUNCTION:	    get_many_avx2
+ *
+ * DESCRIPTION:	    Resolves the landing number and offset for eight indices
+ *		    at a time, and gathers the slots they refer to.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    idx: (const int *) -- The indices desired.
+ *		    out: (void **) -- Receives the user fields.
+ *		    n: (int) -- The number of indices in `idx'.
+ *
+ * RETURN:	    int -- The number of indices resolved, a multiple of 8.
+ *		    The caller handles the remainder.
+ *
+ * NOTES:	    Only used when the growth factor is 2. The landing number
+ *		    is taken from the exponent of the float conversion of
+ *		    (x / F + 1). Rounding may push that one too high, which is
+ *		    corrected by comparing against the power of two it
+ *		    implies.
+ ***/
+static int get_many_avx2(darray * array, const int * idx, void ** out, int n)
+{
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m128i fshift = _mm_cvtsi32_si128(array->fshift);
+  const __m256i bias = _mm256_set1_epi32(127);
+  const __m256i largest = _mm256_set1_epi32(array->largest > INT_MAX ? INT_MAX
+					    : (int)array->largest);
+  const __m256i landings = _mm256_set1_epi32(array->landings);
+  const __m256i zero = _mm256_setzero_si256();
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(idx + i));
+
+    /* 0 <= x <= largest */
+    __m256i valid = _mm256_andnot_si256(_mm256_cmpgt_epi32(zero, x),
+					_mm256_andnot_si256(
+					  _mm256_cmpgt_epi32(x, largest),
+					  _mm256_set1_epi32(-1)));
+    x = _mm256_and_si256(x, valid);
+
+    /* num = floor(log2(x / F + 1)) */
+    __m256i q = _mm256_add_epi32(_mm256_srl_epi32(x, fshift), one);
+    __m256i num = _mm256_sub_epi32(
+      _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(q)), 23),
+      bias);
+    num = _mm256_add_epi32(num, _mm256_cmpgt_epi32(_mm256_sllv_epi32(one,
+								      num),
+						   q));
+
+    /* The landing must also have been allocated */
+    valid = _mm256_and_si256(valid, _mm256_cmpgt_epi32(landings, num));
+    __m256i off = _mm256_sub_epi32(x, _mm256_sll_epi32(
+				     _mm256_sub_epi32(_mm256_sllv_epi32(one,
+									num),
+						      one), fshift));
+
+    for (int h = 0; h < 2; h++) {
+      __m128i num4 = h ? _mm256_extracti128_si256(num, 1)
+	: _mm256_castsi256_si128(num);
+      __m256i off4 = _mm256_cvtepi32_epi64(
+	h ? _mm256_extracti128_si256(off, 1) : _mm256_castsi256_si128(off));
+      __m256i mask = _mm256_cvtepi32_epi64(
+	h ? _mm256_extracti128_si256(valid, 1)
+	: _mm256_castsi256_si128(valid));
+
+      __m256i base = _mm256_mask_i32gather_epi64(
+	_mm256_setzero_si256(), (const long long *)array->landing, num4,
+	mask, 8);
+      __m256i addr = _mm256_add_epi64(base, _mm256_slli_epi64(off4, 3));
+      __m256i slot = _mm256_mask_i64gather_epi64(
+	_mm256_setzero_si256(), (const long long *)0, addr, mask, 1);
+      _mm256_storeu_si256((__m256i *)(out + i + 4 * h), slot);
+    }
+  }
+
+  return i;
+}
+#endif /* CONFIG_DARRAY_AVX2 */
+
 /*****************************************************************************/
@@ -8,7 +8,7 @@
  *
  * CREATED:	    04/16/2018
  *
- * LAST EDITED:	    06/04/2018
+ * LAST EDITED:	    10/18/2026
  ***/
 
 #ifndef __ET_DARRAY_H__
@@ -18,53 +18,516 @@
  * INCLUDES
  ***/
 
-#include "list.h"
+#include <stddef.h>
+#include <string.h>
 
 /******************************************************************************
  * MACRO DEFINITIONS
  ***/
 
+/* The largest index an array may hold, through darray_get64 and friends.
+ * This is far beyond any array of pointers which fits in a 64-bit address
+ * space, but keeps every landing computation exact in a long long.
+ */
+#define DARRAY_INDEX_MAX (((long long)1 << 47) - 1)
+
+/* The maximum number of landings an array may hold. Landing n holds
+ * F * G^n slots, for a first landing size F and growth factor G >= 2, so 48
+ * landings is enough to cover every index up to DARRAY_INDEX_MAX.
+ */
+#define DARRAY_MAX_LANDINGS 48
+
+/* The default number of slots in the first landing. Must be a power of two. */
+#ifndef CONFIG_DARRAY_FIRST_LANDING
+#   define CONFIG_DARRAY_FIRST_LANDING 8
+#endif
+
+/* The default growth factor between landings, as a power of two: each landing
+ * holds 2^CONFIG_DARRAY_GROWTH_SHIFT times as many slots as the one before.
+ */
+#ifndef CONFIG_DARRAY_GROWTH_SHIFT
+#   define CONFIG_DARRAY_GROWTH_SHIFT 1
+#endif
+
+/* The number of empty landings an array keeps past the one holding its
+ * largest element when it contracts, unless changed by darray_set_spare.
+ */
+#ifndef CONFIG_DARRAY_SPARE_LANDINGS
+#   define CONFIG_DARRAY_SPARE_LANDINGS 1
+#endif
+
+/* The size, in 64-bit words, of the storage in each array for its first
+ * landing. The default holds a first landing of 8 pointers, its bitmaps and
+ * its share count, so that an array of a few elements needs no allocation
+ * beyond its header. A first landing which does not fit is allocated as usual.
+ */
+#ifndef CONFIG_DARRAY_INLINE_WORDS
+#   define CONFIG_DARRAY_INLINE_WORDS 11
+#endif
+
+/* The number of entries of the landing directory held in each array's header.
+ * An array which grows past them allocates a directory of DARRAY_MAX_LANDINGS
+ * entries. The default covers 120 elements with the default geometry.
+ */
+#ifndef CONFIG_DARRAY_INLINE_LANDINGS
+#   define CONFIG_DARRAY_INLINE_LANDINGS 4
+#endif
+
+/* Allocations of at least this many bytes by darray_stdlib_allocator (that is,
+ * large landings) are anonymous mappings rather than heap blocks, so that the
+ * kernel supplies their zero pages as they are touched, and freeing them
+ * returns the memory at once. 0 maps nothing. Define CONFIG_DARRAY_HUGEPAGES
+ * as well to ask for transparent huge pages for them.
+ */
+#ifndef CONFIG_DARRAY_MMAP_THRESHOLD
+#   define CONFIG_DARRAY_MMAP_THRESHOLD (1 << 21)
+#endif
+
+/* Define CONFIG_DARRAY_STATS to keep a block of counters in each array, read
+ * with darray_stats. Without it, nothing is counted. It changes the size of
+ * the darray structure, so it, CONFIG_DARRAY_INLINE_WORDS and
+ * CONFIG_DARRAY_INLINE_LANDINGS must be the same in every translation unit
+ * which includes this header, and in the library.
+ */
+
+/* Flags for darray_map: map the file read-only, or copy-on-write. */
+#define DARRAY_MAP_READ 0
+#define DARRAY_MAP_PRIVATE 1
+
 /* The number of non-NULL elements in the array.
  * This is an important distinction from darray_largest.
  */
-#define darray_size(darray) ((darray)->size)
+#define darray_size(darray)					\
+  __atomic_load_n(&(darray)->size, __ATOMIC_RELAXED)
 
 /* The largest index in the array pointing to a non-NULL element. */
-#define darray_largest(darray) ((darray)->largest)
+#define darray_largest(darray)				\
+  __atomic_load_n(&(darray)->largest, __ATOMIC_RELAXED)
 
 /* The number of landings in the array */
-#define darray_landings(darray) ((darray)->landings)
+#define darray_landings(darray)				\
+  __atomic_load_n(&(darray)->landings, __ATOMIC_RELAXED)
 
 /* The number returned by this macro is the total number of locations that
  * are currently allocated to the array. This is not the total amount of memory
  * consumed by the array.
  */
-#define darray_capacity(darray) ((2 ** ((darray)->landings + 2)) - 8)
+#define darray_capacity(darray)						\
+  (((((long long)1 << ((darray)->gshift * (darray)->landings)) - 1)	\
+    / (((long long)1 << (darray)->gshift) - 1)) << (darray)->fshift)
+
+/* The number of slots in landing n of the array */
+#define darray_landing_size(darray, n)					\
+  ((size_t)1 << ((darray)->fshift + (darray)->gshift * (n)))
+
+/* Initializer for a darray_config holding the compile-time defaults. */
+#define DARRAY_CONFIG_DEFAULT {				\
+    .first = CONFIG_DARRAY_FIRST_LANDING,		\
+    .shift = CONFIG_DARRAY_GROWTH_SHIFT,		\
+    .spare = CONFIG_DARRAY_SPARE_LANDINGS,		\
+    .elsize = 0,					\
+    .concurrent = 0,					\
+    .page = 0,						\
+    .allocator = NULL,					\
+    .destroy = NULL					\
+  }
 
 /******************************************************************************
  * TYPE DEFINITIONS
  ***/
 
+/* Memory hooks used by an array for its header and landings. zalloc must
+ * return zeroed memory. free is given the size which was requested, and
+ * every hook is given ctx.
+ */
 typedef struct {
 
-  list * buckets;
-  int size;
-  listelmt * last;
-  int llanding;
-  int largest;
+  void * (*alloc)(void * ctx, size_t size);
+  void * (*zalloc)(void * ctx, size_t size);
+  void (*free)(void * ctx, void * ptr, size_t size);
+  void * ctx;
+
+} darray_allocator;
+
+/* A bump allocator. Memory handed out by an arena is only reclaimed when the
+ * arena is reset or destroyed, which releases every array built in it at
+ * once. An arena must not be shared between threads without a lock.
+ */
+typedef struct darray_arena darray_arena;
+
+/* Counters kept by each array when compiled with CONFIG_DARRAY_STATS, and the
+ * memory held by the array, as reported by darray_stats. The counters are
+ * updated with relaxed atomics, so they may be read while other threads use
+ * a concurrent array.
+ */
+typedef struct {
+
+  /* Elements read (darray_get, darray_get64, darray_get_many and
+   * darray_cursor_get) and written (darray_set and friends).
+   */
+  unsigned long long gets;
+  unsigned long long sets;
+  /* darray_cursor_get calls served by the cursor's cached landing, and those
+   * which looked the landing up again.
+   */
+  unsigned long long cursor_hits;
+  unsigned long long cursor_misses;
+  /* Runs visited while scanning, rather than indexing, the directory: by
+   * darray_span_next, and when darray_largest() moves down.
+   */
+  unsigned long long walked;
+  /* Landings, and pages of sparse arrays, allocated and freed. */
+  unsigned long long landings_allocated;
+  unsigned long long landings_freed;
+  unsigned long long pages_allocated;
+  unsigned long long pages_freed;
+  /* Not counters: computed by darray_stats, even without CONFIG_DARRAY_STATS.
+   * The bytes held by the header, landings and pages, the slots in them,
+   * and the slots in use (darray_size).
+   */
+  size_t bytes;
+  long long slots;
+  long long used;
+
+} darray_statistics;
+
+/* Parameters for darray_create_ex. */
+typedef struct {
+
+  /* The number of slots in the first landing. Must be a power of two. */
+  int first;
+  /* Each landing holds 2^shift times as many slots as the one before. */
+  int shift;
+  /* The number of empty landings to keep when the array contracts. */
+  int spare;
+  /* The size of the inline values held by the array, or 0 for an array of
+   * pointers.
+   */
+  size_t elsize;
+  /* If non-zero, the array may be read and written by several threads at
+   * once (see darray_exchange), through darray_get, darray_set, darray_push,
+   * darray_exchange and darray_cas. The bulk writers (darray_fill and
+   * friends) refuse such an array. Not available for inline values.
+   */
+  int concurrent;
+  /* If non-zero, the array is sparse: landings larger than `page' slots (a
+   * power of two) are split into pages, which are allocated on first write,
+   * and landings are only allocated when written. Not available for
+   * concurrent arrays.
+   */
+  int page;
+  /* Memory hooks for the array, or NULL for darray_stdlib_allocator. The
+   * allocator must outlive the array.
+   */
+  const darray_allocator * allocator;
+  /* Called on each non-NULL element by darray_destroy, if non-NULL. */
+  void (*destroy)(void *);
+
+} darray_config;
+
+typedef struct {
+
+  /* Landing directory: landing[n] points to the nth landing, or NULL. For
+   * arrays of inline values, landings hold elements of elsize bytes. The
+   * directory is `directory' below until the array needs more entries than
+   * it holds, and then DARRAY_MAX_LANDINGS entries from the allocator.
+   */
+  void *** landing;
+  long long size;
+  long long largest;
   int landings;
+  int spare;
+  /* The landings darray_reserve asked for, which contraction keeps until
+   * darray_shrink_to_fit
+   */
+  int reserved;
+  /* log2 of the first landing size, and of the growth factor */
+  int fshift;
+  int gshift;
+  /* Whether the elements are inline values rather than pointers (their size
+   * is elsize, below), and whether the array is concurrent
+   */
+  int values;
+  int concurrent;
+  /* Whether the array is sparse, and log2 of its page size. In a sparse
+   * array, landing[n] may be NULL for any n, and landings larger than a page
+   * hold a table of pointers to their pages, any of which may be NULL.
+   */
+  int sparse;
+  int pshift;
+  /* Whether the landings are a file mapping (see darray_map), whether that
+   * mapping is read-only, and whether the header belongs to the caller (see
+   * darray_init)
+   */
+  int mapped;
+  int readonly;
+  int embedded;
+  size_t elsize;
+  /* Each landing, and each page of a paged landing, is followed by a bitmap
+   * of the slots which hold elements and a summary of the bitmap, for
+   * darray_next and friends. Bit n is set if the bitmaps of landing n are not
+   * kept up to date, and must not be used.
+   */
+  unsigned long long untracked;
+  /* Bit n is set if landing n, or any page of it, may be shared with a clone
+   * (see darray_clone), and so must be copied before it is written. Mapped
+   * arrays (see darray_map) cannot be cloned.
+   */
+  unsigned long long shared;
+  /* Bit n is set if landing n was carved from `block' by darray_reserve,
+   * rather than allocated on its own.
+   */
+  unsigned long long carved;
+  struct darray_block * block;
+  const darray_allocator * allocator;
   void (*destroy)(void *);
+  /* The storage which landing[0] points to when the first landing fits in
+   * it, and the first entries of the landing directory.
+   */
+  _Alignas(max_align_t) unsigned long long local[CONFIG_DARRAY_INLINE_WORDS];
+  void ** directory[CONFIG_DARRAY_INLINE_LANDINGS];
+  /* Last, so that the fields above lie at the same offsets with or without
+   * CONFIG_DARRAY_STATS (see darray_init).
+   */
+#ifdef CONFIG_DARRAY_STATS
+  darray_statistics stats;
+#endif
 
 } darray;
 
+/* A contiguous run of slots within a single landing: base[0] through
+ * base[count - 1] hold the indices first through first + count - 1.
+ */
+typedef struct {
+
+  void ** base;
+  long long first;
+  int count;
+
+} darray_span;
+
+/* Initializer for a darray_span, to begin iteration at index 0. */
+#define DARRAY_SPAN_INIT { .base = NULL, .first = 0, .count = 0 }
+
+/* A caller-owned cache of the landing last visited by darray_cursor_get. Each
+ * thread scanning an array should use its own cursor. A cursor must be reset
+ * with DARRAY_CURSOR_INIT after any call which may release landings, which
+ * includes any write to an array sharing landings with a clone.
+ */
+typedef struct {
+
+  void ** base;
+  long long first;
+  long long end;
+
+} darray_cursor;
+
+/* Initializer for a darray_cursor. */
+#define DARRAY_CURSOR_INIT { .base = NULL, .first = 0, .end = 0 }
+
+/* Callback types for darray_foreach_span and darray_foreach_nonnull. A
+ * non-zero return value stops the iteration.
+ */
+typedef int (*darray_span_fn)(void ** base, long long first, int count,
+			      void * ctx);
+typedef int (*darray_elem_fn)(long long index, void * data, void * ctx);
+
+/* Callback types for darray_parallel_reduce. fold aggregates a run of slots
+ * into the accumulator `acc'; combine merges the partial result `part' into
+ * `acc'.
+ */
+typedef void (*darray_fold_fn)(void * acc, void ** base, long long first,
+			       int count, void * ctx);
+typedef void (*darray_combine_fn)(void * acc, const void * part, void * ctx);
+
+/* Comparison function for darray_sort and darray_bsearch, as for qsort(3):
+ * each argument points to a slot (or, for the first argument of
+ * darray_bsearch, to the key), and the result is <0, 0 or >0.
+ */
+typedef int (*darray_cmp_fn)(const void * a, const void * b);
+
+/* Callback type for darray_compact, told of each element moved from the index
+ * `from' down to the index `to'.
+ */
+typedef void (*darray_remap_fn)(long long from, long long to, void * ctx);
+
+/* Converts the elements of an array of pointers to and from a fixed-size
+ * encoding of `size' bytes, for darray_write and darray_read. encode returns
+ * 0 on success. An encoding of all zero bytes stands for NULL, so decode is
+ * never called on one, and must not return NULL.
+ */
+typedef struct {
+
+  size_t size;
+  int (*encode)(void * data, void * buf, void * ctx);
+  void * (*decode)(const void * buf, void * ctx);
+  void * ctx;
+
+} darray_codec;
+
+/* A pool of threads on which the darray_parallel_* functions run. */
+typedef struct darray_pool darray_pool;
+
+/******************************************************************************
+ * GLOBAL VARIABLES
+ ***/
+
+extern const darray_allocator darray_stdlib_allocator;
+
 /******************************************************************************
  * API FUNCTION PROTOTYPES
  ***/
 
 extern darray * darray_create(void (*destroy)(void *));
+extern darray * darray_create_ex(const darray_config * config);
+extern int darray_init(darray * array, size_t size,
+		       const darray_config * config);
+extern void darray_fini(darray * array);
 extern void * darray_get(darray * array, int index);
 extern int darray_set(darray * array, int index, void * data);
+extern void * darray_get64(darray * array, size_t index);
+extern int darray_set64(darray * array, size_t index, void * data);
+extern void * darray_cursor_seek(darray * array, darray_cursor * cursor,
+				 long long index);
+extern void * darray_exchange(darray * array, int index, void * data);
+extern int darray_cas(darray * array, int index, void * expected,
+		      void * desired);
+extern void * darray_slot(darray * array, long long index, int expand);
+extern int darray_retrack(darray * array);
+extern int darray_set_value(darray * array, int index, const void * value);
+extern int darray_get_many(darray * array, const int * idx, void ** out,
+			   int n);
+extern int darray_set_many(darray * array, const int * idx,
+			   void * const * data, int n);
+extern long long darray_min(darray * array);
+extern long long darray_next(darray * array, long long index);
+extern long long darray_prev(darray * array, long long index);
+extern int darray_set_spare(darray * array, int spare);
+extern int darray_compact(darray * array, darray_remap_fn remap, void * ctx);
+extern int darray_reserve(darray * array, long long n);
+extern int darray_shrink_to_fit(darray * array);
+extern darray * darray_clone(darray * array);
+extern int darray_unshare(darray * array);
+extern int darray_push(darray * array, void * data);
+extern int darray_append_range(darray * array, void * const * src, int n);
+extern int darray_fill(darray * array, int from, int to, void * value);
+extern int darray_copy_out(darray * array, int from, int to, void ** dst);
+extern int darray_span_next(darray * array, darray_span * span);
+extern int darray_foreach_span(darray * array, darray_span_fn cb,
+			       void * ctx);
+extern int darray_foreach_nonnull(darray * array, darray_elem_fn cb,
+				  void * ctx);
+extern int darray_stats(darray * array, darray_statistics * out);
+extern void darray_stats_reset(darray * array);
 extern void darray_destroy(darray ** array);
+extern int darray_destroy_step(darray ** array, size_t budget);
+extern int darray_destroy_async(darray ** array);
+
+extern darray_pool * darray_pool_create(int threads);
+extern void darray_pool_destroy(darray_pool ** pool);
+extern int darray_parallel_foreach(darray * array, darray_pool * pool,
+				   darray_span_fn fn, void * ctx);
+extern int darray_parallel_reduce(darray * array, darray_pool * pool,
+				  darray_fold_fn fold,
+				  darray_combine_fn combine, void * acc,
+				  size_t accsize, void * ctx);
+extern int darray_sort(darray * array, darray_cmp_fn cmp);
+extern int darray_parallel_sort(darray * array, darray_pool * pool,
+				darray_cmp_fn cmp);
+extern long long darray_bsearch(darray * array, const void * key,
+				darray_cmp_fn cmp);
+
+extern int darray_save(darray * array, const char * path);
+extern darray * darray_map(const char * path, int flags);
+extern int darray_write(darray * array, int fd, const darray_codec * codec);
+extern darray * darray_read(int fd, const darray_codec * codec,
+			    const darray_config * config);
+
+extern darray_arena * darray_arena_create(size_t chunk);
+extern const darray_allocator * darray_arena_allocator(darray_arena * arena);
+extern void darray_arena_reset(darray_arena * arena);
+extern void darray_arena_destroy(darray_arena ** arena);
+
+/******************************************************************************
+ * INLINE FUNCTIONS
+ ***/
+
+/* Equivalent to darray_get(array, index), but when `index' lies in the same
+ * landing as the previous call with `cursor', the landing lookup is skipped.
+ * Neither call writes to the array, so any number of threads may scan the
+ * same array, each with its own cursor.
+ */
+static inline void * darray_cursor_get(darray * array, darray_cursor * cursor,
+				       long long index)
+{
+  if (index >= cursor->first && index < cursor->end
+      && index <= __atomic_load_n(&array->largest, __ATOMIC_ACQUIRE)) {
+#ifdef CONFIG_DARRAY_STATS
+    __atomic_fetch_add(&array->stats.gets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&array->stats.cursor_hits, 1, __ATOMIC_RELAXED);
+#endif
+    return __atomic_load_n(&cursor->base[index - cursor->first],
+			   __ATOMIC_ACQUIRE);
+  }
+  return darray_cursor_seek(array, cursor, index);
+}
+
+/******************************************************************************
+ * INLINE VALUE ARRAYS
+ ***/
+
+/* DARRAY_DEFINE(name, T) generates an array type `name' which stores values of
+ * type T inline in its landings, rather than pointers to them, along with:
+ *
+ *   name * name_create(void (*destroy)(void *))
+ *   T name_get(name * array, int index)
+ *   int name_set(name * array, int index, T value)
+ *   T * name_ptr(name * array, int index)
+ *   void name_destroy(name ** array)
+ *
+ * name_get returns a zeroed T for elements which have not been set, and an
+ * element whose bytes are all zero counts as empty. name_ptr allocates the
+ * landing holding `index' if necessary; writes through it are not counted by
+ * darray_size, which is only exact if every element is changed by name_set.
+ * If given, destroy is called with a pointer to each non-empty element. The
+ * result is a darray, so every darray_* macro and function which is not
+ * specific to pointers (e.g. darray_span_next) applies to it.
+ */
+#define DARRAY_DEFINE(name, T)						\
+  typedef darray name;							\
+									\
+  static inline name * name##_create(void (*destroy)(void *))		\
+  {									\
+    darray_config config = DARRAY_CONFIG_DEFAULT;			\
+    config.elsize = sizeof(T);						\
+    config.destroy = destroy;						\
+    return darray_create_ex(&config);					\
+  }									\
+									\
+  static inline T name##_get(name * array, int index)			\
+  {									\
+    T value;								\
+    const T * slot = (const T *)darray_slot(array, index, 0);		\
+    if (slot != NULL && index <= darray_largest(array))			\
+      return *slot;							\
+    memset(&value, 0, sizeof(T));					\
+    return value;							\
+  }									\
+									\
+  static inline int name##_set(name * array, int index, T value)	\
+  {									\
+    return darray_set_value(array, index, &value);			\
+  }									\
+									\
+  static inline T * name##_ptr(name * array, int index)			\
+  {									\
+    return (T *)darray_slot(array, index, 1);				\
+  }									\
+									\
+  static inline void name##_destroy(name ** array)			\
+  {									\
+    darray_destroy(array);						\
+  }
 
 #endif /* __ET_DARRAY_H__ */
 
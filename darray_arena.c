@@ -0,0 +1,277 @@
+/******************************************************************************
+ * NAME:	    darray_arena.c
+ *
+ * AUTHOR:	    Ethan D. Twardy
+ *
+ * DESCRIPTION:	    C source file for the arena (bump) allocator, which can
+ *		    back any number of Dynamic Arrays and release all of them
+ *		    at once.
+ *
+ * CREATED:	    10/18/2026
+ *
+ * LAST EDITED:	    10/18/2026
+ ***/
+
+/******************************************************************************
+ * INCLUDES
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "darray.h"
+
+/******************************************************************************
+ * MACRO DEFINITIONS
+ ***/
+
+/* The chunk size used when darray_arena_create is given 0 */
+#ifndef CONFIG_DARRAY_ARENA_CHUNK
+#   define CONFIG_DARRAY_ARENA_CHUNK (64 * 1024)
+#endif
+
+/* Round x up to the alignment of any object */
+#define Align(x) (((x) + alignof(max_align_t) - 1)			\
+		  & ~(size_t)(alignof(max_align_t) - 1))
+
+/* The usable memory of a chunk */
+#define Data(c) ((char *)(c) + Align(sizeof(struct chunk)))
+
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+struct chunk {
+
+  struct chunk * next;
+  size_t size;
+
+};
+
+struct darray_arena {
+
+  darray_allocator allocator;
+  struct chunk * head;
+  size_t used;
+  size_t chunk;
+
+};
+
+/******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ***/
+
+static void * arena_alloc(void * ctx, size_t size);
+static void * arena_zalloc(void * ctx, size_t size);
+static void arena_free(void * ctx, void * ptr, size_t size);
+
+/******************************************************************************
+ * API FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    darray_arena_create
+ *
+ * DESCRIPTION:	    Create a new, empty arena and return a pointer to it.
+ *
+ * ARGUMENTS:	    chunk: (size_t) -- The number of bytes the arena requests
+ *			from malloc at a time, or 0 for the default. Requests
+ *			larger than this are given a chunk of their own.
+ *
+ * RETURN:	    (darray_arena *) -- Pointer to the new arena, or NULL.
+ *
+ * NOTES:	    O(1)
+ ***/
+darray_arena * darray_arena_create(size_t chunk)
+{
+  darray_arena * arena = NULL;
+  if ((arena = malloc(sizeof(darray_arena))) == NULL)
+    return NULL;
+
+  *arena = (darray_arena){
+    .allocator = {
+      .alloc = arena_alloc,
+      .zalloc = arena_zalloc,
+      .free = arena_free,
+      .ctx = arena
+    },
+    .head = NULL,
+    .used = 0,
+    .chunk = Align(chunk == 0 ? CONFIG_DARRAY_ARENA_CHUNK : chunk)
+  };
+
+  return arena;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_arena_allocator
+ *
+ * DESCRIPTION:	    Returns the allocator hooks which allocate from `arena',
+ *		    suitable for darray_config.allocator.
+ *
+ * ARGUMENTS:	    arena: (darray_arena *) -- The arena.
+ *
+ * RETURN:	    (const darray_allocator *) -- The hooks, or NULL.
+ *
+ * NOTES:	    O(1)
+ ***/
+const darray_allocator * darray_arena_allocator(darray_arena * arena)
+{
+  if (arena == NULL)
+    return NULL;
+  return &arena->allocator;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_arena_reset
+ *
+ * DESCRIPTION:	    Reclaims all memory handed out by the arena. Every array
+ *		    allocated from the arena becomes invalid, and no destroy
+ *		    functions are called. One chunk is kept for reuse.
+ *
+ * ARGUMENTS:	    arena: (darray_arena *) -- The arena to reset.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(chunks)
+ ***/
+void darray_arena_reset(darray_arena * arena)
+{
+  if (arena == NULL || arena->head == NULL)
+    return;
+
+  struct chunk * keep = arena->head->size == arena->chunk ? arena->head : NULL;
+  struct chunk * c = keep != NULL ? keep->next : arena->head;
+  while (c != NULL) {
+    struct chunk * next = c->next;
+    free(c);
+    c = next;
+  }
+
+  if (keep != NULL)
+    keep->next = NULL;
+  arena->head = keep;
+  arena->used = 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_arena_destroy
+ *
+ * DESCRIPTION:	    Frees the arena and all memory handed out by it. Every
+ *		    array allocated from the arena becomes invalid.
+ *
+ * ARGUMENTS:	    arena: (darray_arena **) -- Pointer to the arena.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(chunks)
+ ***/
+void darray_arena_destroy(darray_arena ** arena)
+{
+  if (arena == NULL || *arena == NULL)
+    return;
+
+  struct chunk * c = (*arena)->head;
+  while (c != NULL) {
+    struct chunk * next = c->next;
+    free(c);
+    c = next;
+  }
+
+  free(*arena);
+  *arena = NULL;
+}
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    arena_alloc
+ *
+ * DESCRIPTION:	    The alloc hook of an arena. Bumps the position in the
+ *		    current chunk, starting a new chunk when it is exhausted.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- The arena.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    O(1)
+ ***/
+static void * arena_alloc(void * ctx, size_t size)
+{
+  darray_arena * arena = (darray_arena *)ctx;
+  size = Align(size);
+
+  if (arena->head != NULL && size <= arena->head->size - arena->used) {
+    void * p = Data(arena->head) + arena->used;
+    arena->used += size;
+    return p;
+  }
+
+  size_t csize = size > arena->chunk ? size : arena->chunk;
+  struct chunk * c = NULL;
+  if ((c = malloc(Align(sizeof(struct chunk)) + csize)) == NULL)
+    return NULL;
+  c->size = csize;
+
+  /* Oversized requests get a chunk of their own, which is kept behind the
+   * current chunk so that its free space is not abandoned.
+   */
+  if (size > arena->chunk && arena->head != NULL) {
+    c->next = arena->head->next;
+    arena->head->next = c;
+    return Data(c);
+  }
+
+  c->next = arena->head;
+  arena->head = c;
+  arena->used = size;
+  return Data(c);
+}
+
+/******************************************************************************
+ * FUNCTION:	    arena_zalloc
+ *
+ * DESCRIPTION:	    The zalloc hook of an arena.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- The arena.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the zeroed memory, or NULL.
+ *
+ * NOTES:	    Chunks are reused after a reset, so the memory is always
+ *		    cleared.
+ ***/
+static void * arena_zalloc(void * ctx, size_t size)
+{
+  void * p = arena_alloc(ctx, size);
+  if (p != NULL)
+    memset(p, 0, size);
+  return p;
+}
+
+/******************************************************************************
+ * FUNCTION:	    arena_free
+ *
+ * DESCRIPTION:	    The free hook of an arena, which does nothing: memory is
+ *		    reclaimed by darray_arena_reset().
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    ptr: (void *) -- Unused.
+ *		    size: (size_t) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void arena_free(void * ctx, void * ptr, size_t size)
+{
+  (void)ctx;
+  (void)ptr;
+  (void)size;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,515 @@
+/******************************************************************************
+ * NAME:	    darray_bench.c
+ *
+ * AUTHOR:	    Ethan D. Twardy
+ *
+ * DESCRIPTION:	    Benchmark program for the Dynamic Array abstract type. It
+ *		    measures darray_get and darray_set under several access
+ *		    patterns, growth from empty and darray_destroy, for sizes
+ *		    from 10 up to 10^8, against a vector grown by doubling with
+ *		    realloc. Results are written to stdout as JSON.
+ *
+ * CREATED:	    10/18/2026
+ *
+ * LAST EDITED:	    10/18/2026
+ ***/
+
+/******************************************************************************
+ * INCLUDES
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "darray.h"
+
+/******************************************************************************
+ * MACRO DEFINITIONS
+ ***/
+
+/* The largest array size measured, unless given on the command line */
+#ifndef CONFIG_BENCH_MAX_SIZE
+#   define CONFIG_BENCH_MAX_SIZE 100000000ll
+#endif
+
+/* The fewest operations in each measurement. Small arrays are passed over
+ * repeatedly until this many have been timed.
+ */
+#ifndef CONFIG_BENCH_MIN_OPS
+#   define CONFIG_BENCH_MIN_OPS (1ll << 22)
+#endif
+
+/* The number of operations timed together as one sample */
+#define BATCH 1024
+
+/* The stride of the strided pattern. It is prime, so it visits every index
+ * of an array whose size is a power of ten.
+ */
+#define STRIDE 1000003ll
+
+/* Runs `body' for `count' indices `i' of the pattern in `st', which carries
+ * the position in the pattern from one batch to the next.
+ */
+#define Pattern(st, count, n, i, body)					\
+  switch ((st)->pattern) {						\
+  case SEQUENTIAL:							\
+    for (long long k_ = 0; k_ < (count); k_++) {			\
+      long long i = (st)->pos;						\
+      if (++(st)->pos == (n)) (st)->pos = 0;				\
+      body;								\
+    }									\
+    break;								\
+  case STRIDED:								\
+    for (long long k_ = 0; k_ < (count); k_++) {			\
+      long long i = (st)->pos;						\
+      if (((st)->pos += (st)->stride) >= (n)) (st)->pos -= (n);		\
+      body;								\
+    }									\
+    break;								\
+  case REVERSE:								\
+    for (long long k_ = 0; k_ < (count); k_++) {			\
+      long long i = (n) - 1 - (st)->pos;				\
+      if (++(st)->pos == (n)) (st)->pos = 0;				\
+      body;								\
+    }									\
+    break;								\
+  case RANDOM:								\
+    for (long long k_ = 0; k_ < (count); k_++) {			\
+      (st)->pos ^= (st)->pos << 13;					\
+      (st)->pos ^= (long long)((unsigned long long)(st)->pos >> 7);	\
+      (st)->pos ^= (st)->pos << 17;					\
+      long long i = (long long)((unsigned long long)(st)->pos % (n));	\
+      body;								\
+    }									\
+    break;								\
+  }
+
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+enum pattern { SEQUENTIAL, STRIDED, REVERSE, RANDOM };
+enum impl { DARRAY, VECTOR };
+
+/* The baseline: a contiguous array which doubles with realloc */
+typedef struct {
+
+  void ** data;
+  long long size;
+  long long capacity;
+
+} vector;
+
+/* The position in an access pattern */
+typedef struct {
+
+  enum pattern pattern;
+  long long pos;
+  long long stride;
+
+} cursor;
+
+/* The per-sample timings of one measurement, in ns/op */
+typedef struct {
+
+  double * samples;
+  long long count;
+  long long capacity;
+
+} timings;
+
+/******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ***/
+
+static double now_ns(void);
+static long peak_rss_kb(void);
+static int vector_push(vector * vec, void * data);
+static void vector_free(vector * vec);
+static void time_access(enum impl impl, int set, enum pattern pattern,
+			darray * array, vector * vec, long long n,
+			timings * t);
+static void time_growth(enum impl impl, long long n, timings * t);
+static void time_destroy(enum impl impl, long long n, timings * t);
+static void record(timings * t, double ns_per_op);
+static int compare_double(const void * a, const void * b);
+static void report(const char * op, const char * pattern, enum impl impl,
+		   long long n, timings * t);
+
+/******************************************************************************
+ * GLOBAL VARIABLES
+ ***/
+
+static const char * pattern_names[] = {
+  "sequential", "strided", "reverse", "random"
+};
+static const char * impl_names[] = { "darray", "vector" };
+
+/* Written by every read, so that the reads cannot be optimized away */
+static volatile void * sink;
+
+/* Every element stored points here */
+static int datum;
+
+/* Separates the entries of the JSON array */
+static int entries;
+
+/******************************************************************************
+ * MAIN
+ ***/
+
+int main(int argc, char * argv[])
+{
+  long long max = CONFIG_BENCH_MAX_SIZE;
+  if (argc > 1 && (max = atoll(argv[1])) < 10) {
+    fprintf(stderr, "Usage: %s [largest size, at least 10]\n", argv[0]);
+    return 1;
+  }
+
+  timings t = { .samples = NULL, .count = 0, .capacity = 0 };
+  printf("{\n  \"results\": [\n");
+
+  for (long long n = 10; n <= max; n *= 10) {
+    for (int impl = DARRAY; impl <= VECTOR; impl++) {
+      time_growth(impl, n, &t);
+      report("grow", "sequential", impl, n, &t);
+      time_destroy(impl, n, &t);
+      report("destroy", "none", impl, n, &t);
+
+      /* The reads and writes share one array of each kind */
+      darray * array = NULL;
+      vector vec = { .data = NULL, .size = 0, .capacity = 0 };
+      if (impl == DARRAY) {
+	if ((array = darray_create(NULL)) == NULL)
+	  return 1;
+	for (long long i = 0; i < n; i++) {
+	  if (darray_set64(array, i, &datum))
+	    return 1;
+	}
+      } else {
+	for (long long i = 0; i < n; i++) {
+	  if (vector_push(&vec, &datum))
+	    return 1;
+	}
+      }
+
+      for (int set = 0; set <= 1; set++) {
+	for (int p = SEQUENTIAL; p <= RANDOM; p++) {
+	  time_access(impl, set, p, array, &vec, n, &t);
+	  report(set ? "set" : "get", pattern_names[p], impl, n, &t);
+	}
+      }
+
+      darray_destroy(&array);
+      vector_free(&vec);
+    }
+  }
+
+  printf("\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+  free(t.samples);
+  return 0;
+}
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    now_ns
+ *
+ * DESCRIPTION:	    Returns the time on the monotonic clock.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    double -- The time, in nanoseconds.
+ *
+ * NOTES:	    none.
+ ***/
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/******************************************************************************
+ * FUNCTION:	    peak_rss_kb
+ *
+ * DESCRIPTION:	    Returns the peak resident set size of the process so far.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    long -- The peak RSS, in KiB.
+ *
+ * NOTES:	    none.
+ ***/
+static long peak_rss_kb(void)
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+  return usage.ru_maxrss;
+}
+
+/******************************************************************************
+ * FUNCTION:	    vector_push
+ *
+ * DESCRIPTION:	    Appends `data' to the vector, doubling its capacity with
+ *		    realloc when it is full.
+ *
+ * ARGUMENTS:	    vec: (vector *) -- The vector.
+ *		    data: (void *) -- The data to append.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    Amortized O(1)
+ ***/
+static int vector_push(vector * vec, void * data)
+{
+  if (vec->size == vec->capacity) {
+    long long capacity = vec->capacity == 0 ? 8 : vec->capacity * 2;
+    void ** grown = realloc(vec->data, capacity * sizeof(void *));
+    if (grown == NULL)
+      return -1;
+    vec->data = grown;
+    vec->capacity = capacity;
+  }
+
+  vec->data[vec->size++] = data;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    vector_free
+ *
+ * DESCRIPTION:	    Frees the memory held by the vector, and empties it.
+ *
+ * ARGUMENTS:	    vec: (vector *) -- The vector.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void vector_free(vector * vec)
+{
+  free(vec->data);
+  *vec = (vector){ .data = NULL, .size = 0, .capacity = 0 };
+}
+
+/******************************************************************************
+ * FUNCTION:	    time_access
+ *
+ * DESCRIPTION:	    Times reads or writes of an array of `n' elements in the
+ *		    given pattern, in batches of BATCH operations, for at least
+ *		    CONFIG_BENCH_MIN_OPS operations and one pass over the array.
+ *
+ * ARGUMENTS:	    impl: (enum impl) -- The implementation to time.
+ *		    set: (int) -- non-zero to time writes, rather than reads.
+ *		    pattern: (enum pattern) -- The order of the indices.
+ *		    array: (darray *) -- The darray, for DARRAY.
+ *		    vec: (vector *) -- The vector, for VECTOR.
+ *		    n: (long long) -- The number of elements.
+ *		    t: (timings *) -- Receives the samples.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void time_access(enum impl impl, int set, enum pattern pattern,
+			darray * array, vector * vec, long long n,
+			timings * t)
+{
+  cursor st = {
+    .pattern = pattern,
+    .pos = pattern == RANDOM ? 0x9e3779b97f4a7c15ll : 0,
+    .stride = STRIDE % n
+  };
+  long long total = n > CONFIG_BENCH_MIN_OPS ? n : CONFIG_BENCH_MIN_OPS;
+
+  t->count = 0;
+  for (long long done = 0; done < total; done += BATCH) {
+    long long count = total - done < BATCH ? total - done : BATCH;
+    double start = now_ns();
+    if (impl == DARRAY && set) {
+      Pattern(&st, count, n, i, darray_set64(array, i, &datum));
+    } else if (impl == DARRAY) {
+      Pattern(&st, count, n, i, sink = darray_get64(array, i));
+    } else if (set) {
+      Pattern(&st, count, n, i, vec->data[i] = &datum);
+    } else {
+      Pattern(&st, count, n, i, sink = vec->data[i]);
+    }
+    record(t, (now_ns() - start) / count);
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    time_growth
+ *
+ * DESCRIPTION:	    Times growing an array from empty to `n' elements by
+ *		    appending, repeated for at least CONFIG_BENCH_MIN_OPS
+ *		    appends. Each sample is one array.
+ *
+ * ARGUMENTS:	    impl: (enum impl) -- The implementation to time.
+ *		    n: (long long) -- The number of elements.
+ *		    t: (timings *) -- Receives the samples.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    Freeing each array is not timed.
+ ***/
+static void time_growth(enum impl impl, long long n, timings * t)
+{
+  t->count = 0;
+  for (long long done = 0; done < n || done < CONFIG_BENCH_MIN_OPS;
+       done += n) {
+    darray * array = NULL;
+    vector vec = { .data = NULL, .size = 0, .capacity = 0 };
+    if (impl == DARRAY && (array = darray_create(NULL)) == NULL)
+      return;
+
+    double start = now_ns();
+    if (impl == DARRAY) {
+      for (long long i = 0; i < n; i++)
+	darray_set64(array, i, &datum);
+    } else {
+      for (long long i = 0; i < n; i++)
+	vector_push(&vec, &datum);
+    }
+    record(t, (now_ns() - start) / n);
+
+    darray_destroy(&array);
+    vector_free(&vec);
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    time_destroy
+ *
+ * DESCRIPTION:	    Times freeing an array of `n' elements, repeated for at
+ *		    least CONFIG_BENCH_MIN_OPS elements. Each sample is one
+ *		    array, in ns per element.
+ *
+ * ARGUMENTS:	    impl: (enum impl) -- The implementation to time.
+ *		    n: (long long) -- The number of elements.
+ *		    t: (timings *) -- Receives the samples.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    Building each array is not timed.
+ ***/
+static void time_destroy(enum impl impl, long long n, timings * t)
+{
+  t->count = 0;
+  for (long long done = 0; done < n || done < CONFIG_BENCH_MIN_OPS;
+       done += n) {
+    darray * array = NULL;
+    vector vec = { .data = NULL, .size = 0, .capacity = 0 };
+    if (impl == DARRAY) {
+      if ((array = darray_create(NULL)) == NULL)
+	return;
+      for (long long i = 0; i < n; i++)
+	darray_set64(array, i, &datum);
+    } else {
+      for (long long i = 0; i < n; i++)
+	vector_push(&vec, &datum);
+    }
+
+    double start = now_ns();
+    if (impl == DARRAY)
+      darray_destroy(&array);
+    else
+      vector_free(&vec);
+    record(t, (now_ns() - start) / n);
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    record
+ *
+ * DESCRIPTION:	    Adds a sample to the timings, growing them as necessary.
+ *
+ * ARGUMENTS:	    t: (timings *) -- The timings.
+ *		    ns_per_op: (double) -- The sample.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    Samples which cannot be stored are dropped.
+ ***/
+static void record(timings * t, double ns_per_op)
+{
+  if (t->count == t->capacity) {
+    long long capacity = t->capacity == 0 ? 1024 : t->capacity * 2;
+    double * grown = realloc(t->samples, capacity * sizeof(double));
+    if (grown == NULL)
+      return;
+    t->samples = grown;
+    t->capacity = capacity;
+  }
+
+  t->samples[t->count++] = ns_per_op;
+}
+
+/******************************************************************************
+ * FUNCTION:	    compare_double
+ *
+ * DESCRIPTION:	    Comparison function for qsort() over doubles.
+ *
+ * ARGUMENTS:	    a: (const void *) -- Pointer to the first double.
+ *		    b: (const void *) -- Pointer to the second double.
+ *
+ * RETURN:	    int -- <0, 0 or >0 as a is less than, equal to or greater
+ *		    than b.
+ *
+ * NOTES:	    none.
+ ***/
+static int compare_double(const void * a, const void * b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/******************************************************************************
+ * FUNCTION:	    report
+ *
+ * DESCRIPTION:	    Writes one result to stdout as a JSON object: the mean
+ *		    ns/op and the percentiles of the samples, and the peak RSS
+ *		    of the process so far.
+ *
+ * ARGUMENTS:	    op: (const char *) -- The operation measured.
+ *		    pattern: (const char *) -- The access pattern.
+ *		    impl: (enum impl) -- The implementation measured.
+ *		    n: (long long) -- The number of elements.
+ *		    t: (timings *) -- The samples. They are sorted.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void report(const char * op, const char * pattern, enum impl impl,
+		   long long n, timings * t)
+{
+  if (t->count == 0)
+    return;
+
+  double sum = 0;
+  for (long long i = 0; i < t->count; i++)
+    sum += t->samples[i];
+  qsort(t->samples, t->count, sizeof(double), compare_double);
+
+#define Percentile(p) (t->samples[(long long)((t->count - 1) * (p))])
+  printf("%s    {\"op\": \"%s\", \"pattern\": \"%s\", \"impl\": \"%s\", "
+	 "\"n\": %lld, \"ns_per_op\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+	 "\"p99\": %.3f, \"max\": %.3f, \"samples\": %lld, "
+	 "\"peak_rss_kb\": %ld}",
+	 entries++ ? ",\n" : "", op, pattern, impl_names[impl], n,
+	 sum / t->count, Percentile(0.5), Percentile(0.9), Percentile(0.99),
+	 t->samples[t->count - 1], t->count, peak_rss_kb());
+#undef Percentile
+  fflush(stdout);
+}
+
+/*****************************************************************************/
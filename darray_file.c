@@ -0,0 +1,807 @@
+/******************************************************************************
+ * NAME:	    darray_file.c
+ *
+ * AUTHOR:	    Ethan D. Twardy
+ *
+ * DESCRIPTION:	    C source file for saving Dynamic Arrays of inline values
+ *		    to files whose layout mirrors the landings, for mapping
+ *		    such files back into memory as arrays, and for streaming
+ *		    arrays over pipes and sockets.
+ *
+ * CREATED:	    10/18/2026
+ *
+ * LAST EDITED:	    10/18/2026
+ ***/
+
+/******************************************************************************
+ * INCLUDES
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "darray.h"
+
+/******************************************************************************
+ * MACRO DEFINITIONS
+ ***/
+
+/* The alignment of each landing in a file, so that each landing begins on its
+ * own page when the file is mapped.
+ */
+#ifndef CONFIG_DARRAY_FILE_ALIGN
+#   define CONFIG_DARRAY_FILE_ALIGN 4096
+#endif
+
+/* Identifies a darray file, and the byte order of the machine which wrote it */
+#define FILE_MAGIC "DARRAY\0\1"
+#define FILE_ORDER 0x01020304u
+#define FILE_VERSION 1u
+
+/* The number of runs gathered into each writev() of a stream */
+#ifndef CONFIG_DARRAY_STREAM_BATCH
+#   define CONFIG_DARRAY_STREAM_BATCH 64
+#endif
+
+/* The size of the buffer through which encoded elements are streamed */
+#ifndef CONFIG_DARRAY_STREAM_BUFFER
+#   define CONFIG_DARRAY_STREAM_BUFFER (64 * 1024)
+#endif
+
+/* The most buffers a single writev() accepts, if the system does not say. This
+ * is the least POSIX allows.
+ */
+#ifndef IOV_MAX
+#   define IOV_MAX 16
+#endif
+
+/* Identifies a darray stream */
+#define STREAM_MAGIC "DARRAYS\1"
+
+/* Round x up to a multiple of the file alignment */
+#define Align(x) (((x) + CONFIG_DARRAY_FILE_ALIGN - 1)			\
+		  & ~(uint64_t)(CONFIG_DARRAY_FILE_ALIGN - 1))
+
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+/* The header at the start of a file. Landing n occupies the bytes from
+ * offset[n] (a multiple of the file alignment) for its full size, whether or
+ * not it was allocated; unwritten parts of it are holes in the file.
+ */
+struct file_header {
+
+  char magic[8];
+  uint32_t order;
+  uint32_t version;
+  uint32_t fshift;
+  uint32_t gshift;
+  uint32_t landings;
+  uint32_t pad;
+  uint64_t elsize;
+  int64_t size;
+  int64_t largest;
+  uint64_t offset[DARRAY_MAX_LANDINGS];
+
+};
+
+/* The header at the start of a stream. It is followed by any number of runs,
+ * each a struct stream_run and then `count' elements of elsize bytes, and a
+ * final run with a count of 0.
+ */
+struct stream_header {
+
+  char magic[8];
+  uint32_t order;
+  uint32_t version;
+  uint32_t fshift;
+  uint32_t gshift;
+  uint32_t page;
+  uint32_t values;
+  uint64_t elsize;
+  int64_t size;
+  int64_t largest;
+
+};
+
+struct stream_run {
+
+  int64_t first;
+  int64_t count;
+
+};
+
+/* The allocator of a mapped array. Landings in the mapping are never freed;
+ * the mapping is released along with the array header.
+ */
+struct mapping {
+
+  darray_allocator allocator;
+  darray * array;
+  char * base;
+  size_t length;
+
+};
+
+/******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ***/
+
+static int write_all(int fd, const void * buf, size_t len, uint64_t off);
+static int writev_all(int fd, struct iovec * iov, int n);
+static int read_all(int fd, void * buf, size_t len);
+static int write_encoded(int fd, const darray_span * span,
+			 const darray_codec * codec, char * buf);
+static int read_run(int fd, darray * array, const struct stream_run * run,
+		    const darray_codec * codec, char * buf);
+static void * mapping_alloc(void * ctx, size_t size);
+static void * mapping_zalloc(void * ctx, size_t size);
+static void mapping_free(void * ctx, void * ptr, size_t size);
+
+/******************************************************************************
+ * API FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    darray_save
+ *
+ * DESCRIPTION:	    Writes an array of inline values to the file at `path', in
+ *		    a form which darray_map() can map back into memory. Each
+ *		    landing is written page-aligned with its full size, and
+ *		    pages which were never allocated are left as holes.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to save. Must hold inline
+ *			values.
+ *		    path: (const char *) -- The file to create or replace.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened, with
+ *		    errno set by the failing call.
+ *
+ * NOTES:	    O(n) in the allocated size of the array.
+ ***/
+int darray_save(darray * array, const char * path)
+{
+  if (array == NULL || path == NULL || !array->values)
+    return -1;
+
+  struct file_header header = {
+    .magic = FILE_MAGIC,
+    .order = FILE_ORDER,
+    .version = FILE_VERSION,
+    .fshift = (uint32_t)array->fshift,
+    .gshift = (uint32_t)array->gshift,
+    .landings = (uint32_t)array->landings,
+    .elsize = array->elsize,
+    .size = array->size,
+    .largest = array->largest
+  };
+
+  /* Lay the landings out after the header */
+  uint64_t end = Align(sizeof(header));
+  for (int n = 0; n < array->landings; n++) {
+    header.offset[n] = end;
+    end = Align(end + darray_landing_size(array, n) * array->elsize);
+  }
+
+  int fd = -1;
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    return -1;
+  if (write_all(fd, &header, sizeof(header), 0) || ftruncate(fd, end)) {
+    close(fd);
+    return -1;
+  }
+
+  /* Spans arrive in order of increasing index, so the landing holding each
+   * is found by walking forward through the landing sizes.
+   */
+  int n = 0;
+  long long start = 0;
+  darray_span span = DARRAY_SPAN_INIT;
+  while (darray_span_next(array, &span) == 1) {
+    while (span.first >= start + (long long)darray_landing_size(array, n))
+      start += darray_landing_size(array, n++);
+
+    uint64_t off = header.offset[n] + (span.first - start) * array->elsize;
+    if (write_all(fd, span.base, span.count * array->elsize, off)) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  return close(fd);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_map
+ *
+ * DESCRIPTION:	    Maps a file written by darray_save() into memory, and
+ *		    returns an array whose landings are the mapped file. Pages
+ *		    are faulted in from the file as they are first used, so a
+ *		    large array is available immediately.
+ *
+ * ARGUMENTS:	    path: (const char *) -- The file to map.
+ *		    flags: (int) -- DARRAY_MAP_READ to map the file read-only,
+ *			or DARRAY_MAP_PRIVATE to map it copy-on-write.
+ *
+ * RETURN:	    (darray *) -- Pointer to the array, or NULL if the file
+ *		    could not be mapped or is not a darray file.
+ *
+ * NOTES:	    O(landings). Every write to a DARRAY_MAP_READ array is
+ *		    refused. Changes to a DARRAY_MAP_PRIVATE array are never
+ *		    written to the file. The mapping is released by
+ *		    darray_destroy().
+ ***/
+darray * darray_map(const char * path, int flags)
+{
+  if (path == NULL || (flags != DARRAY_MAP_READ
+		       && flags != DARRAY_MAP_PRIVATE))
+    return NULL;
+
+  int fd = -1;
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+
+  /* Validate the header against the file before trusting any of it */
+  struct file_header header;
+  struct stat st;
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+      || fstat(fd, &st) != 0
+      || memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0
+      || header.order != FILE_ORDER || header.version != FILE_VERSION
+      || header.landings > DARRAY_MAX_LANDINGS) {
+    close(fd);
+    return NULL;
+  }
+
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.first = header.fshift < 31 ? 1 << header.fshift : 0;
+  config.shift = (int)header.gshift;
+  config.elsize = header.elsize;
+
+  struct mapping * m = NULL;
+  if ((m = malloc(sizeof(struct mapping))) == NULL) {
+    close(fd);
+    return NULL;
+  }
+  *m = (struct mapping){
+    .allocator = {
+      .alloc = mapping_alloc,
+      .zalloc = mapping_zalloc,
+      .free = mapping_free,
+      .ctx = m
+    },
+    .array = NULL,
+    .base = NULL,
+    .length = 0
+  };
+  config.allocator = &m->allocator;
+
+  darray * array = NULL;
+  if (config.elsize == 0 || (array = darray_create_ex(&config)) == NULL) {
+    free(m);
+    close(fd);
+    return NULL;
+  }
+  m->array = array;
+
+  /* Every landing must lie within the file, and the counts within them */
+  uint64_t length = (uint64_t)st.st_size;
+  long long capacity = 0;
+  int valid = header.size >= 0 && header.largest >= 0
+    && header.largest <= DARRAY_INDEX_MAX && header.size <= header.largest + 1;
+  for (uint32_t n = 0; valid && n < header.landings; n++) {
+    valid = header.fshift + header.gshift * n < 56
+      && header.offset[n] % CONFIG_DARRAY_FILE_ALIGN == 0
+      && header.offset[n] <= length
+      && darray_landing_size(array, n)
+      <= (length - header.offset[n]) / array->elsize;
+    capacity += valid ? (long long)darray_landing_size(array, n) : 0;
+  }
+  if (!valid || (header.landings == 0 ? header.largest != 0
+		 : header.largest >= capacity)) {
+    darray_destroy(&array);
+    close(fd);
+    return NULL;
+  }
+
+  if (header.landings > 0) {
+    int prot = flags == DARRAY_MAP_READ ? PROT_READ : PROT_READ | PROT_WRITE;
+    int share = flags == DARRAY_MAP_READ ? MAP_SHARED : MAP_PRIVATE;
+    void * base = mmap(NULL, length, prot, share, fd, 0);
+    if (base == MAP_FAILED) {
+      darray_destroy(&array);
+      close(fd);
+      return NULL;
+    }
+    m->base = base;
+    m->length = length;
+  }
+  close(fd);
+
+  /* A directory outgrowing the header is allocated as darray_destroy expects
+   * to free it: DARRAY_MAX_LANDINGS entries from the array's allocator
+   */
+  if (header.landings > CONFIG_DARRAY_INLINE_LANDINGS) {
+    void *** dir = NULL;
+    if ((dir = array->allocator->zalloc(array->allocator->ctx,
+					DARRAY_MAX_LANDINGS
+					* sizeof(void **))) == NULL) {
+      darray_destroy(&array);
+      return NULL;
+    }
+    array->landing = dir;
+  }
+
+  /* The file holds no occupancy bitmaps, so none are kept for its landings */
+  for (uint32_t n = 0; n < header.landings; n++)
+    array->landing[n] = (void **)(m->base + header.offset[n]);
+  array->landings = (int)header.landings;
+  array->untracked = ~0ull;
+  array->mapped = 1;
+  array->readonly = flags == DARRAY_MAP_READ;
+  array->size = header.size;
+  array->largest = header.largest;
+  return array;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_write
+ *
+ * DESCRIPTION:	    Streams the array to `fd', which may be a pipe or socket,
+ *		    for darray_read() to rebuild. The allocated runs of an
+ *		    array of inline values are written straight from their
+ *		    landings, each as one iovec of a writev(). The elements of
+ *		    an array of pointers are encoded by `codec'.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to stream.
+ *		    fd: (int) -- The file descriptor to write to.
+ *		    codec: (const darray_codec *) -- Encodes the elements of
+ *			an array of pointers. Ignored (and may be NULL) for an
+ *			array of inline values.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened, with
+ *		    errno set by the failing call.
+ *
+ * NOTES:	    O(n) in the allocated size of the array.
+ ***/
+int darray_write(darray * array, int fd, const darray_codec * codec)
+{
+  if (array == NULL || fd < 0)
+    return -1;
+  if (!array->values && (codec == NULL || codec->encode == NULL
+			 || codec->size == 0))
+    return -1;
+
+  struct stream_header header = {
+    .magic = STREAM_MAGIC,
+    .order = FILE_ORDER,
+    .version = FILE_VERSION,
+    .fshift = (uint32_t)array->fshift,
+    .gshift = (uint32_t)array->gshift,
+    .page = array->sparse ? 1u << array->pshift : 0,
+    .values = (uint32_t)array->values,
+    .elsize = array->values ? array->elsize : codec->size,
+    .size = array->size,
+    .largest = array->largest
+  };
+  struct iovec iov[2 * CONFIG_DARRAY_STREAM_BATCH + 1];
+  iov[0] = (struct iovec){ .iov_base = &header, .iov_len = sizeof(header) };
+  if (writev_all(fd, iov, 1))
+    return -1;
+
+  /* Encoded elements pass through a buffer, one piece at a time */
+  char * buf = NULL;
+  if (!array->values && (buf = malloc(CONFIG_DARRAY_STREAM_BUFFER
+				      > codec->size
+				      ? CONFIG_DARRAY_STREAM_BUFFER
+				      : codec->size)) == NULL)
+    return -1;
+
+  /* Inline values are gathered CONFIG_DARRAY_STREAM_BATCH runs at a time */
+  struct stream_run runs[CONFIG_DARRAY_STREAM_BATCH + 1];
+  int n = 0, ret = 0;
+  darray_span span = DARRAY_SPAN_INIT;
+  while (ret == 0 && darray_span_next(array, &span) == 1) {
+    if (!array->values) {
+      ret = write_encoded(fd, &span, codec, buf);
+      continue;
+    }
+
+    runs[n] = (struct stream_run){ .first = span.first, .count = span.count };
+    iov[2 * n] = (struct iovec){
+      .iov_base = &runs[n], .iov_len = sizeof(struct stream_run)
+    };
+    iov[2 * n + 1] = (struct iovec){
+      .iov_base = span.base, .iov_len = span.count * array->elsize
+    };
+    if (++n == CONFIG_DARRAY_STREAM_BATCH) {
+      ret = writev_all(fd, iov, 2 * n);
+      n = 0;
+    }
+  }
+
+  /* The final run, with a count of 0, marks the end of the stream */
+  runs[n] = (struct stream_run){ .first = -1, .count = 0 };
+  iov[2 * n] = (struct iovec){
+    .iov_base = &runs[n], .iov_len = sizeof(struct stream_run)
+  };
+  if (ret == 0)
+    ret = writev_all(fd, iov, 2 * n + 1);
+
+  free(buf);
+  return ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_read
+ *
+ * DESCRIPTION:	    Rebuilds an array from a stream written by darray_write().
+ *		    The new array has the landing geometry of the one written,
+ *		    so each run is read straight into its landing (or page)
+ *		    without calling darray_set() per element.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file descriptor to read from.
+ *		    codec: (const darray_codec *) -- Decodes the elements of
+ *			an array of pointers. Ignored (and may be NULL) for an
+ *			array of inline values.
+ *		    config: (const darray_config *) -- Supplies the allocator
+ *			and destroy function of the new array, or NULL for the
+ *			defaults. Its other fields are ignored.
+ *
+ * RETURN:	    (darray *) -- Pointer to the new array, or NULL if the
+ *		    stream could not be read or is not a darray stream.
+ *
+ * NOTES:	    O(n) in the size of the stream. On failure, the stream is
+ *		    left part way through.
+ ***/
+darray * darray_read(int fd, const darray_codec * codec,
+		     const darray_config * config)
+{
+  struct stream_header header;
+  if (fd < 0 || read_all(fd, &header, sizeof(header))
+      || memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0
+      || header.order != FILE_ORDER || header.version != FILE_VERSION
+      || header.fshift > 24 || header.page > (1u << 24)
+      || header.size < 0 || header.largest < 0
+      || header.largest > DARRAY_INDEX_MAX
+      || header.size > header.largest + 1)
+    return NULL;
+  if (!header.values && (codec == NULL || codec->decode == NULL
+			 || codec->size != header.elsize))
+    return NULL;
+
+  darray_config geometry = DARRAY_CONFIG_DEFAULT;
+  if (config != NULL) {
+    geometry.allocator = config->allocator;
+    geometry.destroy = config->destroy;
+  }
+  geometry.first = 1 << header.fshift;
+  geometry.shift = (int)header.gshift;
+  geometry.page = (int)header.page;
+  geometry.elsize = header.values ? header.elsize : 0;
+
+  darray * array = NULL;
+  if ((header.values && header.elsize == 0)
+      || (array = darray_create_ex(&geometry)) == NULL)
+    return NULL;
+
+  char * buf = NULL;
+  if (!header.values && (buf = malloc(CONFIG_DARRAY_STREAM_BUFFER
+				      > codec->size
+				      ? CONFIG_DARRAY_STREAM_BUFFER
+				      : codec->size)) == NULL) {
+    darray_destroy(&array);
+    return NULL;
+  }
+
+  /* Each run raises the largest index as it is read, so that on failure the
+   * destroy function is called on the elements decoded so far.
+   */
+  struct stream_run run;
+  int ret = 0;
+  while ((ret = read_all(fd, &run, sizeof(run))) == 0 && run.count != 0) {
+    if (run.first < 0 || run.count < 0 || run.count > INT_MAX
+	|| run.first > header.largest - run.count + 1
+	|| (ret = read_run(fd, array, &run, codec, buf)) != 0)
+      break;
+  }
+
+  free(buf);
+  if (ret != 0 || run.count != 0 || darray_retrack(array) != 0) {
+    darray_destroy(&array);
+    return NULL;
+  }
+
+  /* darray_retrack has rebuilt the bitmaps and counted the elements, but
+   * each run raised the largest index to its own end. The stream's own
+   * figure is not trusted, as it may name an empty slot.
+   */
+  long long largest = darray_prev(array, array->largest + 1);
+  array->largest = largest < 0 ? 0 : largest;
+  return array;
+}
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    write_all
+ *
+ * DESCRIPTION:	    Writes `len' bytes at `off' in the file, retrying after
+ *		    short writes.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file.
+ *		    buf: (const void *) -- The bytes to write.
+ *		    len: (size_t) -- The number of bytes to write.
+ *		    off: (uint64_t) -- The offset in the file.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    none.
+ ***/
+static int write_all(int fd, const void * buf, size_t len, uint64_t off)
+{
+  const char * p = (const char *)buf;
+  while (len > 0) {
+    ssize_t ret = pwrite(fd, p, len, (off_t)off);
+    if (ret < 0)
+      return -1;
+    p += ret;
+    off += ret;
+    len -= ret;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    writev_all
+ *
+ * DESCRIPTION:	    Writes every byte described by `iov', retrying after short
+ *		    writes, as are common on pipes and sockets.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file descriptor to write to.
+ *		    iov: (struct iovec *) -- The buffers to write. They are
+ *			modified as the write progresses.
+ *		    n: (int) -- The number of buffers in `iov'.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    none.
+ ***/
+static int writev_all(int fd, struct iovec * iov, int n)
+{
+  while (n > 0) {
+    ssize_t ret = writev(fd, iov, n > IOV_MAX ? IOV_MAX : n);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0)
+      return -1;
+
+    /* Skip the buffers which were written in full */
+    while (n > 0 && (size_t)ret >= iov->iov_len) {
+      ret -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + ret;
+      iov->iov_len -= ret;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    read_all
+ *
+ * DESCRIPTION:	    Reads exactly `len' bytes, retrying after short reads.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file descriptor to read from.
+ *		    buf: (void *) -- Receives the bytes.
+ *		    len: (size_t) -- The number of bytes to read.
+ *
+ * RETURN:	    int -- 0 if successful, -1 on error or end of file.
+ *
+ * NOTES:	    none.
+ ***/
+static int read_all(int fd, void * buf, size_t len)
+{
+  char * p = (char *)buf;
+  while (len > 0) {
+    ssize_t ret = read(fd, p, len);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return -1;
+    p += ret;
+    len -= ret;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    write_encoded
+ *
+ * DESCRIPTION:	    Streams a span of an array of pointers, encoding it into
+ *		    `buf' a piece at a time. NULL elements are sent as zeros,
+ *		    without calling the encoder.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file descriptor to write to.
+ *		    span: (const darray_span *) -- The span to stream.
+ *		    codec: (const darray_codec *) -- The element encoder.
+ *		    buf: (char *) -- The staging buffer.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(span->count)
+ ***/
+static int write_encoded(int fd, const darray_span * span,
+			 const darray_codec * codec, char * buf)
+{
+  int piece = CONFIG_DARRAY_STREAM_BUFFER / codec->size;
+  if (piece == 0)
+    piece = 1;
+
+  for (int from = 0; from < span->count; from += piece) {
+    int count = span->count - from < piece ? span->count - from : piece;
+    memset(buf, 0, count * codec->size);
+    for (int i = 0; i < count; i++) {
+      void * data = span->base[from + i];
+      if (data != NULL
+	  && codec->encode(data, buf + i * codec->size, codec->ctx) != 0)
+	return -1;
+    }
+
+    struct stream_run run = { .first = span->first + from, .count = count };
+    struct iovec iov[2] = {
+      { .iov_base = &run, .iov_len = sizeof(run) },
+      { .iov_base = buf, .iov_len = count * codec->size }
+    };
+    if (writev_all(fd, iov, 2))
+      return -1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    read_run
+ *
+ * DESCRIPTION:	    Reads the elements of one run into the array. Inline
+ *		    values are read straight into the landing; encoded
+ *		    elements are read into `buf' and decoded a piece at a time,
+ *		    and all-zero encodings are left NULL.
+ *
+ * ARGUMENTS:	    fd: (int) -- The file descriptor to read from.
+ *		    array: (darray *) -- The array being rebuilt.
+ *		    run: (const struct stream_run *) -- The run to read.
+ *		    codec: (const darray_codec *) -- The element decoder.
+ *		    buf: (char *) -- The staging buffer.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(run->count)
+ ***/
+static int read_run(int fd, darray * array, const struct stream_run * run,
+		    const darray_codec * codec, char * buf)
+{
+  /* The run must be contiguous in the array, as it was in the writer's */
+  long long last = run->first + run->count - 1;
+  char * base = NULL, * end = NULL;
+  if ((base = darray_slot(array, run->first, 1)) == NULL
+      || (end = darray_slot(array, last, 1)) == NULL
+      || end != base + (size_t)(last - run->first) * array->elsize)
+    return -1;
+
+  /* A run cut short is cleared, so that no partial element is destroyed */
+  if (array->values) {
+    if (read_all(fd, base, run->count * array->elsize) == 0)
+      return 0;
+    memset(base, 0, run->count * array->elsize);
+    return -1;
+  }
+
+  void ** slot = (void **)base;
+  size_t size = codec->size;
+  int piece = CONFIG_DARRAY_STREAM_BUFFER / size;
+  if (piece == 0)
+    piece = 1;
+
+  for (long long from = 0; from < run->count; from += piece) {
+    int count = (int)(run->count - from < piece ? run->count - from : piece);
+    if (read_all(fd, buf, count * size))
+      return -1;
+    for (int i = 0; i < count; i++) {
+      const char * rec = buf + i * size;
+      size_t j = 0;
+      while (j < size && rec[j] == 0)
+	j++;
+      slot[from + i] = j < size ? codec->decode(rec, codec->ctx) : NULL;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    mapping_alloc
+ *
+ * DESCRIPTION:	    The alloc hook of a mapped array. Landings allocated after
+ *		    the array was mapped come from malloc.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * mapping_alloc(void * ctx, size_t size)
+{
+  (void)ctx;
+  return malloc(size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    mapping_zalloc
+ *
+ * DESCRIPTION:	    The zalloc hook of a mapped array.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the zeroed memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * mapping_zalloc(void * ctx, size_t size)
+{
+  (void)ctx;
+  return calloc(1, size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    mapping_free
+ *
+ * DESCRIPTION:	    The free hook of a mapped array. Memory within the mapping
+ *		    is left alone, and freeing the array header, which is the
+ *		    last thing darray_destroy() frees, releases the mapping.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- The mapping.
+ *		    ptr: (void *) -- The memory to free.
+ *		    size: (size_t) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void mapping_free(void * ctx, void * ptr, size_t size)
+{
+  struct mapping * m = (struct mapping *)ctx;
+  (void)size;
+
+  if ((char *)ptr >= m->base && (char *)ptr < m->base + m->length)
+    return;
+
+  free(ptr);
+  if (ptr == m->array) {
+    if (m->base != NULL)
+      munmap(m->base, m->length);
+    free(m);
+  }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,995 @@
+/******************************************************************************
+ * NAME:	    darray_parallel.c
+ *
+ * AUTHOR:	    Ethan D. Twardy
+ *
+ * DESCRIPTION:	    C source file for the parallel operations on the Dynamic
+ *		    Array abstract type, and the work-stealing thread pool
+ *		    which runs them. Sorting, which runs on the pool when it
+ *		    is given one, and binary search live here too.
+ *
+ * CREATED:	    10/18/2026
+ *
+ * LAST EDITED:	    10/18/2026
+ ***/
+
+/******************************************************************************
+ * INCLUDES
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "darray.h"
+
+/******************************************************************************
+ * MACRO DEFINITIONS
+ ***/
+
+/* The smallest number of elements worth handing to a thread on its own */
+#ifndef CONFIG_DARRAY_PARALLEL_GRAIN
+#   define CONFIG_DARRAY_PARALLEL_GRAIN 4096
+#endif
+
+/* The number of chunks to aim for per thread, so that there is something
+ * left to steal when one thread falls behind.
+ */
+#ifndef CONFIG_DARRAY_PARALLEL_SPLIT
+#   define CONFIG_DARRAY_PARALLEL_SPLIT 4
+#endif
+
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+/* A run of elements within a single landing */
+struct chunk {
+
+  void ** base;
+  long long first;
+  int count;
+
+};
+
+/* The chunks a worker has yet to run: [lo, hi). The owner takes from lo,
+ * thieves take from hi.
+ */
+struct deque {
+
+  pthread_mutex_t lock;
+  int lo;
+  int hi;
+
+};
+
+/* Two adjacent sorted ranges of indices, [lo, mid) and [mid, hi), to merge */
+struct merge {
+
+  long long lo;
+  long long mid;
+  long long hi;
+
+};
+
+/* The run of slots last used to reach an index: base holds the index first,
+ * and the run continues up to (but excluding) end.
+ */
+struct window {
+
+  darray * array;
+  char * base;
+  long long first;
+  long long end;
+
+};
+
+struct job {
+
+  const struct chunk * chunks;
+  int (*run)(struct job * job, int chunk);
+
+  /* For darray_parallel_foreach */
+  darray_span_fn fn;
+
+  /* For darray_parallel_reduce */
+  darray_fold_fn fold;
+  char * partial;
+  size_t accsize;
+
+  /* For darray_parallel_sort */
+  darray * array;
+  darray_cmp_fn cmp;
+  const struct merge * merges;
+
+  void * ctx;
+  int stop;
+  int ret;
+
+};
+
+struct darray_pool {
+
+  pthread_mutex_t submit;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned long generation;
+  int shutdown;
+  int active;
+  int threads;
+  struct job * job;
+  struct deque * deques;
+  pthread_t * tids;
+
+};
+
+struct worker {
+
+  darray_pool * pool;
+  int id;
+
+};
+
+/******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ***/
+
+static struct chunk * make_chunks(darray * array, int threads, int * n);
+static int run_job(darray_pool * pool, struct job * job, int chunks);
+static void work(darray_pool * pool, struct job * job, int id);
+static int take(struct deque * deque, int steal);
+static void * worker_main(void * arg);
+static int run_foreach(struct job * job, int chunk);
+static int run_fold(struct job * job, int chunk);
+static int run_sort(struct job * job, int chunk);
+static int run_merge(struct job * job, int chunk);
+static int merge_ranges(darray * array, darray_cmp_fn cmp,
+			const struct merge * m);
+static char * at(struct window * w, long long index);
+static void transfer(struct window * w, long long from, long long count,
+		     char * buf, int in);
+
+/******************************************************************************
+ * API FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    darray_pool_create
+ *
+ * DESCRIPTION:	    Create a pool of threads for the darray_parallel_*()
+ *		    functions. The calling thread of each operation takes part
+ *		    in it, so `threads' - 1 threads are started.
+ *
+ * ARGUMENTS:	    threads: (int) -- The number of threads to run operations
+ *			on, or 0 for the number of online processors.
+ *
+ * RETURN:	    (darray_pool *) -- Pointer to the new pool, or NULL.
+ *
+ * NOTES:	    O(threads)
+ ***/
+darray_pool * darray_pool_create(int threads)
+{
+  if (threads < 0)
+    return NULL;
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (int)online : 1;
+  }
+
+  darray_pool * pool = NULL;
+  if ((pool = calloc(1, sizeof(darray_pool))) == NULL)
+    return NULL;
+  pool->threads = threads;
+  if ((pool->deques = calloc(threads, sizeof(struct deque))) == NULL
+      || (pool->tids = calloc(threads, sizeof(pthread_t))) == NULL) {
+    free(pool->deques);
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->submit, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < threads; i++)
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+  /* Thread 0 is whichever thread submits an operation */
+  for (int i = 1; i < threads; i++) {
+    struct worker * worker = NULL;
+    if ((worker = malloc(sizeof(struct worker))) != NULL)
+      *worker = (struct worker){ .pool = pool, .id = i };
+    if (worker == NULL
+	|| pthread_create(&pool->tids[i], NULL, worker_main, worker)) {
+      free(worker);
+      pool->threads = i;
+      darray_pool_destroy(&pool);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_pool_destroy
+ *
+ * DESCRIPTION:	    Stops the threads of a pool and frees it.
+ *
+ * ARGUMENTS:	    pool: (darray_pool **) -- Pointer to the pool.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    Must not be called while an operation is running.
+ ***/
+void darray_pool_destroy(darray_pool ** pool)
+{
+  if (pool == NULL || *pool == NULL)
+    return;
+
+  darray_pool * p = *pool;
+  pthread_mutex_lock(&p->lock);
+  p->shutdown = 1;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+  for (int i = 1; i < p->threads; i++)
+    pthread_join(p->tids[i], NULL);
+
+  for (int i = 0; i < p->threads; i++)
+    pthread_mutex_destroy(&p->deques[i].lock);
+  pthread_cond_destroy(&p->done);
+  pthread_cond_destroy(&p->wake);
+  pthread_mutex_destroy(&p->lock);
+  pthread_mutex_destroy(&p->submit);
+  free(p->tids);
+  free(p->deques);
+  free(p);
+  *pool = NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_parallel_foreach
+ *
+ * DESCRIPTION:	    Invokes `fn' on every slot of the array up to and including
+ *		    darray_largest(), split into runs which are spread across
+ *		    the threads of `pool'. Runs never cross a landing boundary,
+ *		    and large landings are split into several runs, so that
+ *		    the work is balanced.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    pool: (darray_pool *) -- The threads to use, or NULL to
+ *			run on the calling thread only.
+ *		    fn: (darray_span_fn) -- User function, called with the
+ *			base, first index and length of each run. It may be
+ *			called from several threads at once.
+ *		    ctx: (void *) -- Passed through to `fn'.
+ *
+ * RETURN:	    int -- 0 if every run was visited, the non-zero value
+ *		    returned by `fn' if it stopped the operation (in which
+ *		    case some runs may not be visited), or -1 if something
+ *		    bad happened.
+ *
+ * NOTES:	    The array must not be modified during the operation,
+ *		    except through the slots handed to `fn'. Any landing the
+ *		    array shares with a clone is copied first (see
+ *		    darray_unshare), so that `fn' may write to its slots.
+ ***/
+int darray_parallel_foreach(darray * array, darray_pool * pool,
+			    darray_span_fn fn, void * ctx)
+{
+  if (array == NULL || fn == NULL || darray_unshare(array))
+    return -1;
+
+  int n = 0;
+  struct chunk * chunks = NULL;
+  if ((chunks = make_chunks(array, pool ? pool->threads : 1, &n)) == NULL)
+    return -1;
+
+  struct job job = {
+    .chunks = chunks,
+    .run = run_foreach,
+    .fn = fn,
+    .ctx = ctx
+  };
+  int ret = run_job(pool, &job, n);
+  free(chunks);
+  return ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_parallel_reduce
+ *
+ * DESCRIPTION:	    Aggregates every slot of the array up to and including
+ *		    darray_largest() into `acc', using the threads of `pool'.
+ *		    The slots are split into runs as for
+ *		    darray_parallel_foreach(). Each run is folded into its own
+ *		    copy of the initial `acc' by `fold', then the copies are
+ *		    merged into `acc' by `combine', in order of index.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    pool: (darray_pool *) -- The threads to use, or NULL to
+ *			run on the calling thread only.
+ *		    fold: (darray_fold_fn) -- Folds a run into an
+ *			accumulator. It may be called from several threads at
+ *			once, each with a different accumulator.
+ *		    combine: (darray_combine_fn) -- Merges a partial result
+ *			into `acc'. Called on the calling thread.
+ *		    acc: (void *) -- The accumulator. On entry, it must hold
+ *			the identity value of `combine'.
+ *		    accsize: (size_t) -- The size of the accumulator.
+ *		    ctx: (void *) -- Passed through to `fold' and `combine'.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    The array must not be modified during the operation.
+ ***/
+int darray_parallel_reduce(darray * array, darray_pool * pool,
+			   darray_fold_fn fold, darray_combine_fn combine,
+			   void * acc, size_t accsize, void * ctx)
+{
+  if (array == NULL || fold == NULL || combine == NULL || acc == NULL
+      || accsize == 0)
+    return -1;
+
+  int n = 0;
+  struct chunk * chunks = NULL;
+  char * partial = NULL;
+  if ((chunks = make_chunks(array, pool ? pool->threads : 1, &n)) == NULL)
+    return -1;
+  if (n > 0 && (partial = malloc(n * accsize)) == NULL) {
+    free(chunks);
+    return -1;
+  }
+  for (int i = 0; i < n; i++)
+    memcpy(partial + i * accsize, acc, accsize);
+
+  struct job job = {
+    .chunks = chunks,
+    .run = run_fold,
+    .fold = fold,
+    .partial = partial,
+    .accsize = accsize,
+    .ctx = ctx
+  };
+  int ret = run_job(pool, &job, n);
+  for (int i = 0; ret == 0 && i < n; i++)
+    combine(acc, partial + i * accsize, ctx);
+
+  free(partial);
+  free(chunks);
+  return ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_sort
+ *
+ * DESCRIPTION:	    Sorts the elements of the array in place, in the order
+ *		    given by `cmp'. Equivalent to darray_parallel_sort() with
+ *		    no pool.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to sort.
+ *		    cmp: (darray_cmp_fn) -- The comparison function, given
+ *			pointers to two slots.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(nlogn)
+ ***/
+int darray_sort(darray * array, darray_cmp_fn cmp)
+{
+  return darray_parallel_sort(array, NULL, cmp);
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_parallel_sort
+ *
+ * DESCRIPTION:	    Sorts the elements of the array in place, using the
+ *		    threads of `pool'. The slots are split into runs as for
+ *		    darray_parallel_foreach(), and each run is sorted with
+ *		    qsort(). Adjacent runs are then merged pairwise, every
+ *		    merge at one level in parallel, until one run remains.
+ *		    Each merge buffers only the shorter of its two runs, so
+ *		    at most half of the array is ever copied out. The sort is
+ *		    stable across runs, but not within them.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to sort. Every slot up to
+ *			darray_largest() must hold an element, as counted by
+ *			darray_size().
+ *		    pool: (darray_pool *) -- The threads to use, or NULL to
+ *			run on the calling thread only.
+ *		    cmp: (darray_cmp_fn) -- The comparison function, given
+ *			pointers to two slots. It may be called from several
+ *			threads at once.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened. On
+ *		    failure, every element is still in the array, but the
+ *		    array may only be partly sorted.
+ *
+ * NOTES:	    O(nlogn). The array must not be used by other threads
+ *		    during the operation. Landings shared with a clone are
+ *		    copied first (see darray_unshare).
+ ***/
+int darray_parallel_sort(darray * array, darray_pool * pool,
+			 darray_cmp_fn cmp)
+{
+  if (array == NULL || cmp == NULL || array->readonly)
+    return -1;
+  long long size = darray_size(array);
+  if (size == 0)
+    return 0;
+  if (size != darray_largest(array) + 1 || darray_unshare(array))
+    return -1;
+
+  int n = 0;
+  struct chunk * chunks = NULL;
+  struct merge * merges = NULL;
+  long long * bounds = NULL;
+  if ((chunks = make_chunks(array, pool ? pool->threads : 1, &n)) == NULL)
+    return -1;
+  if ((merges = malloc(n * sizeof(struct merge))) == NULL
+      || (bounds = malloc((n + 1) * sizeof(long long))) == NULL) {
+    free(merges);
+    free(chunks);
+    return -1;
+  }
+
+  struct job job = {
+    .chunks = chunks,
+    .run = run_sort,
+    .array = array,
+    .cmp = cmp
+  };
+  int ret = run_job(pool, &job, n);
+
+  /* The chunks cover [0, size), and each is now a sorted range */
+  for (int i = 0; i < n; i++)
+    bounds[i] = chunks[i].first;
+  bounds[n] = size;
+  for (int ranges = n; ret == 0 && ranges > 1; ranges = (ranges + 1) / 2) {
+    int count = 0;
+    for (int i = 0; i + 1 < ranges; i += 2) {
+      merges[count++] = (struct merge){
+	.lo = bounds[i],
+	.mid = bounds[i + 1],
+	.hi = bounds[i + 2]
+      };
+    }
+    for (int i = 0; 2 * i < ranges; i++)
+      bounds[i] = bounds[2 * i];
+    bounds[(ranges + 1) / 2] = size;
+
+    job = (struct job){
+      .run = run_merge,
+      .array = array,
+      .cmp = cmp,
+      .merges = merges
+    };
+    ret = run_job(pool, &job, count);
+  }
+
+  free(bounds);
+  free(merges);
+  free(chunks);
+  return ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    darray_bsearch
+ *
+ * DESCRIPTION:	    Finds an element equal to `key' in a sorted array. The
+ *		    landing which may hold it is found by comparing `key' with
+ *		    the last element of each landing, then that landing is
+ *		    searched on its own.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array to search, sorted in the
+ *			order given by `cmp', with every slot up to
+ *			darray_largest() holding an element.
+ *		    key: (const void *) -- The key to search for.
+ *		    cmp: (darray_cmp_fn) -- The comparison function, given
+ *			`key' and a pointer to a slot.
+ *
+ * RETURN:	    long long -- The smallest index holding an element equal
+ *		    to `key', or -1 if there is none.
+ *
+ * NOTES:	    O(logn)
+ ***/
+long long darray_bsearch(darray * array, const void * key, darray_cmp_fn cmp)
+{
+  if (array == NULL || key == NULL || cmp == NULL || darray_size(array) == 0)
+    return -1;
+
+  /* The first index of each landing, up to the one holding largest */
+  long long largest = darray_largest(array);
+  long long starts[DARRAY_MAX_LANDINGS + 1] = {0};
+  int landings = 0;
+  while (starts[landings] <= largest) {
+    starts[landings + 1] = starts[landings]
+      + (long long)darray_landing_size(array, landings);
+    landings++;
+  }
+
+  /* The first landing whose last element is not less than the key */
+  int lo = 0, hi = landings - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const void * last = darray_slot(array, starts[mid + 1] - 1, 0);
+    if (last == NULL)
+      return -1;
+    if (cmp(key, last) <= 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  /* The first element within it which is not less than the key */
+  struct window w = { .array = array, .base = NULL, .first = 0, .end = 0 };
+  long long from = starts[lo];
+  long long to = starts[lo + 1] <= largest ? starts[lo + 1] : largest + 1;
+  long long end = to;
+  while (from < to) {
+    long long mid = from + (to - from) / 2;
+    const char * slot = at(&w, mid);
+    if (slot == NULL)
+      return -1;
+    if (cmp(key, slot) <= 0)
+      to = mid;
+    else
+      from = mid + 1;
+  }
+
+  const char * slot = from < end ? at(&w, from) : NULL;
+  return slot != NULL && cmp(key, slot) == 0 ? from : -1;
+}
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ***/
+
+/******************************************************************************
+ * FUNCTION:	    make_chunks
+ *
+ * DESCRIPTION:	    Splits the array into runs of roughly equal length which
+ *		    never cross a landing boundary. Since landings grow
+ *		    geometrically, splitting only at landing boundaries would
+ *		    leave most of the work in the last landing.
+ *
+ * ARGUMENTS:	    array: (darray *) -- Pointer to the array in question.
+ *		    threads: (int) -- The number of threads to balance for.
+ *		    n: (int *) -- Receives the number of chunks.
+ *
+ * RETURN:	    struct chunk * -- The chunks, or NULL.
+ *
+ * NOTES:	    O(threads + spans)
+ ***/
+static struct chunk * make_chunks(darray * array, int threads, int * n)
+{
+  long long total = (long long)darray_largest(array) + 1;
+  long long grain = total / ((long long)threads
+			     * CONFIG_DARRAY_PARALLEL_SPLIT);
+  if (grain < CONFIG_DARRAY_PARALLEL_GRAIN)
+    grain = CONFIG_DARRAY_PARALLEL_GRAIN;
+
+  /* Each span contributes at most one chunk more than its share. A sparse
+   * array may have a span per page, so they are counted first.
+   */
+  size_t max = (size_t)(total / grain) + 1;
+  darray_span span = DARRAY_SPAN_INIT;
+  while (darray_span_next(array, &span) == 1)
+    max++;
+  struct chunk * chunks = NULL;
+  if ((chunks = malloc(max * sizeof(struct chunk))) == NULL)
+    return NULL;
+
+  *n = 0;
+  span = (darray_span)DARRAY_SPAN_INIT;
+  while (darray_span_next(array, &span) == 1) {
+    int pieces = (int)((span.count + grain - 1) / grain);
+    for (int i = 0; i < pieces; i++) {
+      int from = (int)((long long)span.count * i / pieces);
+      int to = (int)((long long)span.count * (i + 1) / pieces);
+      chunks[(*n)++] = (struct chunk){
+	.base = (void **)((char *)span.base + (size_t)from * array->elsize),
+	.first = span.first + from,
+	.count = to - from
+      };
+    }
+  }
+
+  return chunks;
+}
+
+/******************************************************************************
+ * FUNCTION:	    run_job
+ *
+ * DESCRIPTION:	    Deals the chunks of `job' out to the threads of the pool
+ *		    in contiguous ranges, wakes the threads, and takes part in
+ *		    the job until every chunk has run.
+ *
+ * ARGUMENTS:	    pool: (darray_pool *) -- The pool, or NULL.
+ *		    job: (struct job *) -- The job to run.
+ *		    chunks: (int) -- The number of chunks in the job.
+ *
+ * RETURN:	    int -- job->ret.
+ *
+ * NOTES:	    Operations submitted to the same pool from several threads
+ *		    are run one at a time.
+ ***/
+static int run_job(darray_pool * pool, struct job * job, int chunks)
+{
+  if (pool == NULL || pool->threads == 1 || chunks <= 1) {
+    for (int i = 0; i < chunks && !job->stop; i++)
+      job->run(job, i);
+    return job->ret;
+  }
+
+  pthread_mutex_lock(&pool->submit);
+  for (int i = 0; i < pool->threads; i++) {
+    pthread_mutex_lock(&pool->deques[i].lock);
+    pool->deques[i].lo = (int)((long long)chunks * i / pool->threads);
+    pool->deques[i].hi = (int)((long long)chunks * (i + 1) / pool->threads);
+    pthread_mutex_unlock(&pool->deques[i].lock);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->job = job;
+  pool->active = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  work(pool, job, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pool->job = NULL;
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->submit);
+
+  return job->ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    work
+ *
+ * DESCRIPTION:	    Runs chunks from the worker's own deque, then steals from
+ *		    the other workers until there is nothing left.
+ *
+ * ARGUMENTS:	    pool: (darray_pool *) -- The pool.
+ *		    job: (struct job *) -- The job being run.
+ *		    id: (int) -- The worker's index in the pool.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void work(darray_pool * pool, struct job * job, int id)
+{
+  int chunk = 0;
+  while ((chunk = take(&pool->deques[id], 0)) >= 0) {
+    if (__atomic_load_n(&job->stop, __ATOMIC_RELAXED))
+      return;
+    job->run(job, chunk);
+  }
+
+  for (int i = 1; i < pool->threads; i++) {
+    struct deque * victim = &pool->deques[(id + i) % pool->threads];
+    while ((chunk = take(victim, 1)) >= 0) {
+      if (__atomic_load_n(&job->stop, __ATOMIC_RELAXED))
+	return;
+      job->run(job, chunk);
+    }
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    take
+ *
+ * DESCRIPTION:	    Removes a chunk from a deque: the front for its owner, or
+ *		    the back for a thief.
+ *
+ * ARGUMENTS:	    deque: (struct deque *) -- The deque.
+ *		    steal: (int) -- non-zero to take from the back.
+ *
+ * RETURN:	    int -- The chunk, or -1 if the deque is empty.
+ *
+ * NOTES:	    O(1)
+ ***/
+static int take(struct deque * deque, int steal)
+{
+  int chunk = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->lo < deque->hi)
+    chunk = steal ? --deque->hi : deque->lo++;
+  pthread_mutex_unlock(&deque->lock);
+  return chunk;
+}
+
+/******************************************************************************
+ * FUNCTION:	    worker_main
+ *
+ * DESCRIPTION:	    The body of each pool thread: waits for a job, works on
+ *		    it, and reports when it has run out of chunks.
+ *
+ * ARGUMENTS:	    arg: (void *) -- The struct worker describing the thread,
+ *			which is freed on exit.
+ *
+ * RETURN:	    void * -- NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * worker_main(void * arg)
+{
+  struct worker * worker = (struct worker *)arg;
+  darray_pool * pool = worker->pool;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && pool->generation == seen)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->shutdown)
+      break;
+
+    seen = pool->generation;
+    struct job * job = pool->job;
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, job, worker->id);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  free(worker);
+  return NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    run_foreach
+ *
+ * DESCRIPTION:	    Runs one chunk of darray_parallel_foreach(). The first
+ *		    non-zero return from the user stops the job.
+ *
+ * ARGUMENTS:	    job: (struct job *) -- The job.
+ *		    chunk: (int) -- The chunk to run.
+ *
+ * RETURN:	    int -- The user function's return value.
+ *
+ * NOTES:	    none.
+ ***/
+static int run_foreach(struct job * job, int chunk)
+{
+  const struct chunk * c = &job->chunks[chunk];
+  int ret = job->fn(c->base, c->first, c->count, job->ctx);
+  if (ret != 0) {
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&job->ret, &expected, ret, 0,
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+  }
+  return ret;
+}
+
+/******************************************************************************
+ * FUNCTION:	    run_fold
+ *
+ * DESCRIPTION:	    Runs one chunk of darray_parallel_reduce(), folding it
+ *		    into the chunk's own accumulator.
+ *
+ * ARGUMENTS:	    job: (struct job *) -- The job.
+ *		    chunk: (int) -- The chunk to run.
+ *
+ * RETURN:	    int -- 0.
+ *
+ * NOTES:	    none.
+ ***/
+static int run_fold(struct job * job, int chunk)
+{
+  const struct chunk * c = &job->chunks[chunk];
+  job->fold(job->partial + chunk * job->accsize, c->base, c->first, c->count,
+	    job->ctx);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    run_sort
+ *
+ * DESCRIPTION:	    Runs one chunk of darray_parallel_sort(), sorting it with
+ *		    qsort().
+ *
+ * ARGUMENTS:	    job: (struct job *) -- The job.
+ *		    chunk: (int) -- The chunk to sort.
+ *
+ * RETURN:	    int -- 0.
+ *
+ * NOTES:	    none.
+ ***/
+static int run_sort(struct job * job, int chunk)
+{
+  const struct chunk * c = &job->chunks[chunk];
+  qsort(c->base, c->count, job->array->elsize, job->cmp);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    run_merge
+ *
+ * DESCRIPTION:	    Runs one merge of darray_parallel_sort(). A failure stops
+ *		    the job.
+ *
+ * ARGUMENTS:	    job: (struct job *) -- The job.
+ *		    chunk: (int) -- The merge to run.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    none.
+ ***/
+static int run_merge(struct job * job, int chunk)
+{
+  if (merge_ranges(job->array, job->cmp, &job->merges[chunk]) == 0)
+    return 0;
+
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&job->ret, &expected, -1, 0,
+				  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+  return -1;
+}
+
+/******************************************************************************
+ * FUNCTION:	    merge_ranges
+ *
+ * DESCRIPTION:	    Merges two adjacent sorted ranges of the array in place.
+ *		    The shorter range is copied out, and the merge fills the
+ *		    gap it leaves from the far end of the other range, so
+ *		    that no slot is written before it has been read. Ties are
+ *		    taken from the lower range first.
+ *
+ * ARGUMENTS:	    array: (darray *) -- The array.
+ *		    cmp: (darray_cmp_fn) -- The comparison function.
+ *		    m: (const struct merge *) -- The ranges to merge.
+ *
+ * RETURN:	    int -- 0 if successful, -1 if something bad happened.
+ *
+ * NOTES:	    O(hi - lo), with a buffer of the shorter range.
+ ***/
+static int merge_ranges(darray * array, darray_cmp_fn cmp,
+			const struct merge * m)
+{
+  struct window in = { .array = array, .base = NULL, .first = 0, .end = 0 };
+  struct window out = in;
+  size_t elsize = array->elsize;
+  long long p = m->mid - m->lo, q = m->hi - m->mid;
+  if (p == 0 || q == 0)
+    return 0;
+
+  /* The ranges may already be in order */
+  char * low = at(&in, m->mid - 1), * high = at(&out, m->mid);
+  if (low == NULL || high == NULL)
+    return -1;
+  if (cmp(low, high) <= 0)
+    return 0;
+
+  char * buf = NULL;
+  if ((buf = malloc((size_t)(p < q ? p : q) * elsize)) == NULL)
+    return -1;
+
+  if (p <= q) {
+    /* Buffer the lower range, and merge upwards from lo */
+    transfer(&in, m->lo, p, buf, 0);
+    long long i = 0, j = m->mid, o = m->lo;
+    while (i < p && j < m->hi) {
+      char * right = at(&in, j);
+      const char * src = buf + i * elsize;
+      if (cmp(right, src) < 0) {
+	src = right;
+	j++;
+      } else {
+	i++;
+      }
+      memcpy(at(&out, o++), src, elsize);
+    }
+    transfer(&out, o, p - i, buf + i * elsize, 1);
+  } else {
+    /* Buffer the upper range, and merge downwards from hi */
+    transfer(&in, m->mid, q, buf, 0);
+    long long i = m->mid - 1, j = q - 1, o = m->hi - 1;
+    while (j >= 0 && i >= m->lo) {
+      char * left = at(&in, i);
+      const char * src = buf + j * elsize;
+      if (cmp(src, left) < 0) {
+	src = left;
+	i--;
+      } else {
+	j--;
+      }
+      memcpy(at(&out, o--), src, elsize);
+    }
+    transfer(&out, m->lo, j + 1, buf, 1);
+  }
+
+  free(buf);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    at
+ *
+ * DESCRIPTION:	    Returns the address of the slot holding `index', moving
+ *		    the window to the run (the landing, or the page of a
+ *		    sparse array) holding it if necessary, so that walking a
+ *		    range in either direction looks up each run only once.
+ *
+ * ARGUMENTS:	    w: (struct window *) -- The window.
+ *		    index: (long long) -- The index.
+ *
+ * RETURN:	    char * -- The address of the slot, or NULL if it has not
+ *		    been allocated.
+ *
+ * NOTES:	    O(1), or O(landings) when the window moves.
+ ***/
+static char * at(struct window * w, long long index)
+{
+  if (index < w->first || index >= w->end) {
+    darray * array = w->array;
+    long long first = 0, size = 0;
+    int n = 0;
+    while (index >= first + (size = (long long)darray_landing_size(array, n))) {
+      first += size;
+      n++;
+    }
+    if (array->sparse && size > (1ll << array->pshift)) {
+      size = 1ll << array->pshift;
+      first += (index - first) & ~(size - 1);
+    }
+
+    if ((w->base = darray_slot(array, first, 0)) == NULL) {
+      w->first = w->end = 0;
+      return NULL;
+    }
+    w->first = first;
+    w->end = first + size;
+  }
+
+  return w->base + (size_t)(index - w->first) * w->array->elsize;
+}
+
+/******************************************************************************
+ * FUNCTION:	    transfer
+ *
+ * DESCRIPTION:	    Copies `count' slots beginning at `from' into `buf', or
+ *		    out of it, with one memcpy per run.
+ *
+ * ARGUMENTS:	    w: (struct window *) -- A window onto the array.
+ *		    from: (long long) -- The first index to copy.
+ *		    count: (long long) -- The number of slots to copy.
+ *		    buf: (char *) -- The buffer.
+ *		    in: (int) -- non-zero to copy from `buf' into the array.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    O(count). Every slot must have been allocated.
+ ***/
+static void transfer(struct window * w, long long from, long long count,
+		     char * buf, int in)
+{
+  size_t elsize = w->array->elsize;
+  while (count > 0) {
+    char * slot = at(w, from);
+    long long run = w->end - from < count ? w->end - from : count;
+    if (in)
+      memcpy(slot, buf, (size_t)run * elsize);
+    else
+      memcpy(buf, slot, (size_t)run * elsize);
+    buf += (size_t)run * elsize;
+    from += run;
+    count -= run;
+  }
+}
+
+/*****************************************************************************/
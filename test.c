@@ -19,6 +19,11 @@
 #include <time.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
 
 #include "darray.h"
 
@@ -78,6 +83,20 @@
     exit(1);					\
   }
 
+/******************************************************************************
+ * TYPE DEFINITIONS
+ ***/
+
+typedef struct {
+
+  int key;
+  int flags;
+  double weight;
+
+} record;
+
+DARRAY_DEFINE(record_array, record)
+
 /******************************************************************************
  * GLOBAL VARIABLES
  ***/
@@ -87,6 +106,8 @@ static FILE * logfile;
 #endif
 
 static int failures;
+static int reclaimed;
+static int destroyed;
 
 /******************************************************************************
  * STATIC FUNCTION PROTOTYPES
@@ -96,6 +117,57 @@ static int test_get();
 static int test_set();
 static int test_create();
 static int test_destroy();
+static int test_many();
+static int test_span();
+static int test_bulk();
+static int test_contract();
+static int test_create_ex();
+static int test_allocator();
+static int test_values();
+static int test_concurrent();
+static int test_cursor();
+static int test_parallel();
+static int test_reclaim();
+static int test_sparse();
+static int test_index64();
+static int test_file();
+static int test_stream();
+static int test_stats();
+static int test_occupancy();
+static int test_init();
+static int test_sort();
+static int test_compact();
+static int test_clone();
+static int test_reserve();
+static int test_large();
+static int count_slots(void ** base, long long first, int count,
+		       void * ctx);
+static int clear_slots(void ** base, long long first, int count,
+		       void * ctx);
+static void sum_fold(void * acc, void ** base, long long first, int count,
+		     void * ctx);
+static void sum_combine(void * acc, const void * part, void * ctx);
+static void * push_worker(void * arg);
+static void * write_worker(void * arg);
+static int encode_int(void * data, void * buf, void * ctx);
+static void * decode_int(const void * buf, void * ctx);
+static void count_destroy(void * data);
+static void free_destroy(void * data);
+static void count_reclaim(void * data);
+static void * count_alloc(void * ctx, size_t size);
+static void * count_zalloc(void * ctx, size_t size);
+static void * limit_zalloc(void * ctx, size_t size);
+static void count_free(void * ctx, void * ptr, size_t size);
+static void * lazy_alloc(void * ctx, size_t size);
+static void lazy_free(void * ctx, void * ptr, size_t size);
+static int count_span(void ** base, long long first, int count,
+		      void * ctx);
+static int count_nonnull(long long index, void * data, void * ctx);
+static int count_seen(long long index, void * data, void * ctx);
+static int cmp_int(const void * a, const void * b);
+static int cmp_key(const void * key, const void * slot);
+static int cmp_record(const void * a, const void * b);
+static void note_move(long long from, long long to, void * ctx);
 static darray * prep_darray(int random);
 
 /******************************************************************************
@@ -126,12 +198,58 @@ int main()
 	  "Test (darray_get):\t%s\n"
 	  "Test (darray_set):\t%s\n"
 	  "Test (darray_create):\t%s\n"
-	  "Test (darray_destroy):\t%s\n",
+	  "Test (darray_destroy):\t%s\n"
+	  "Test (darray_*_many):\t%s\n"
+	  "Test (darray_*span*):\t%s\n"
+	  "Test (darray bulk):\t%s\n"
+	  "Test (contraction):\t%s\n"
+	  "Test (darray_create_ex):\t%s\n"
+	  "Test (allocators):\t%s\n"
+	  "Test (DARRAY_DEFINE):\t%s\n"
+	  "Test (concurrent):\t%s\n"
+	  "Test (darray_cursor_get):\t%s\n"
+	  "Test (darray_parallel_*):\t%s\n"
+	  "Test (darray_destroy_*):\t%s\n"
+	  "Test (sparse):\t%s\n"
+	  "Test (darray_*64):\t%s\n"
+	  "Test (darray_save/map):\t%s\n"
+	  "Test (darray_write/read):\t%s\n"
+	  "Test (darray_stats):\t%s\n"
+	  "Test (darray_next/prev):\t%s\n"
+	  "Test (darray_init/fini):\t%s\n"
+	  "Test (darray_sort):\t%s\n"
+	  "Test (darray_compact):\t%s\n"
+	  "Test (darray_clone):\t%s\n"
+	  "Test (darray_reserve):\t%s\n"
+	  "Test (large landings):\t%s\n",
 
 	  test_get()	    ? FAIL"Fail"NC : PASS"Pass"NC,
 	  test_set()	    ? FAIL"Fail"NC : PASS"Pass"NC,
 	  test_create()	    ? FAIL"Fail"NC : PASS"Pass"NC,
-	  test_destroy()    ? FAIL"Fail"NC : PASS"Pass"NC
+	  test_destroy()    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_many()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_span()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_bulk()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_contract()   ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_create_ex()  ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_allocator()  ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_values()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_concurrent() ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_cursor()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_parallel()   ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_reclaim()    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_sparse()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_index64()    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_file()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_stream()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_stats()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_occupancy()  ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_init()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_sort()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_compact()    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_clone()	    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_reserve()    ? FAIL"Fail"NC : PASS"Pass"NC,
+	  test_large()	    ? FAIL"Fail"NC : PASS"Pass"NC
 	  );
 
 #ifdef CONFIG_TEST_LOG
@@ -197,8 +315,8 @@ static int test_get() {
   if (array->landings != old)
     log_fail(Line":test_get(6): changed landings");
 
-  /* Test 7 -- last = NULL; get(0)=get(0) */
-  array->last = NULL;
+  /* Test 7 -- get(largest); get(0)=get(0) */
+  darray_get(array, darray_largest(array));
   if (darray_get(array, 0) == NULL
       || *(int *)darray_get(array, 0) != 9)
     log_fail(Line":test_get(7): should be 9");
@@ -262,10 +380,9 @@ static int test_set() {
       || *(int *)darray_get(array, darray_largest(array)) != 15)
     log_fail(Line":test_set(5): the last entry should be 15.");
 
-  /* landings = NULL; set(0) <-- set(0) */
-  array->last = NULL; /* Here I am affecting the value of an internal
-		       * variable simply for the purpose of testing.
-		       */
+  /* set(largest); set(0) <-- set(0) */
+  if (darray_set(array, darray_largest(array), &onum) != 0)
+    log_fail(Line":test_set(6): darray_set did not return 0.");
   if (darray_set(array, 0, &onum) != 0)
     log_fail(Line":test_set(6): darray_set did not return 0.");
   if (darray_get(array, 0) == NULL
@@ -341,45 +458,2500 @@ static int test_destroy() {
 }
 
 /******************************************************************************
- * FUNCTION:	    prep_darray
+ * FUNCTION:	    test_many
  *
- * DESCRIPTION:	    Prepare a Dynamic Array with some random data for testing.
+ * DESCRIPTION:	    Tests the darray_get_many() and darray_set_many()
+ *		    functions against darray_get().
  *
- * ARGUMENTS:	    random: (int) -- if !0, fill the darray with random data.
+ * ARGUMENTS:	    void.
  *
- * RETURN:	    darray * -- Pointer to a new dynamic array struct.
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
  *
  * NOTES:	    none.
  ***/
-static darray * prep_darray(int random)
-{
+static int test_many() {
+
+  static int nums[64];
+  int idx[64] = {0};
+  void * data[64];
+  void * out[67];
   darray * array = NULL;
-  if ((array = darray_create(free)) == NULL) {
-    log(Line":prep_darray: darray_create returned NULL\n");
-    return NULL;
+
+  /* Test 1 -- NULL inputs */
+  if (darray_get_many(NULL, idx, out, 1) != -1)
+    log_fail(Line":test_many(1): darray_get_many did not return -1.");
+  if (darray_set_many(NULL, idx, data, 1) != -1)
+    log_fail(Line":test_many(1): darray_set_many did not return -1.");
+
+  /* Test 2 -- set_many across many landings */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_many(2): darray_create returned NULL.");
+  for (int i = 0; i < 64; i++) {
+    nums[i] = i;
+    idx[i] = i * i * 7 + (i & 3);
+    data[i] = &nums[i];
+  }
+  if (darray_set_many(array, idx, data, 64) != 0)
+    log_fail(Line":test_many(2): darray_set_many did not return 0.");
+  for (int i = 0; i < 64; i++) {
+    if (darray_get(array, idx[i]) != &nums[i])
+      log_fail(Line":test_many(2): element was not set.");
   }
 
-  static int tmp[] = {9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+  /* Test 3 -- get_many agrees with get, including out of range indices */
+  int probe[67];
+  for (int i = 0; i < 64; i++)
+    probe[i] = (i & 1) ? idx[i] : idx[i] + 1;
+  probe[5] = -1;
+  probe[64] = darray_largest(array) + 1;
+  probe[65] = 0x7fffffff;
+  probe[66] = idx[63];
+  if (darray_get_many(array, probe, out, 67) != 0)
+    log_fail(Line":test_many(3): darray_get_many did not return 0.");
+  for (int i = 0; i < 67; i++) {
+    if (out[i] != darray_get(array, probe[i]))
+      log_fail(Line":test_many(3): disagrees with darray_get.");
+  }
 
-  int * pNum = NULL;
-  for (int i = 0; i < 10; i++) {
-    if ((pNum = malloc(sizeof(int))) == NULL) {
-      log(Line":prep_darray: malloc returned NULL\n");
-      return NULL;
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_span
+ *
+ * DESCRIPTION:	    Tests the darray_span_next(), darray_foreach_span() and
+ *		    darray_foreach_nonnull() functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_span() {
+
+  /* Test 1 -- NULL inputs, empty array */
+  darray * array = NULL;
+  darray_span span = DARRAY_SPAN_INIT;
+  int count = 0;
+  if (darray_span_next(NULL, &span) != -1)
+    log_fail(Line":test_span(1): darray_span_next did not return -1.");
+  if (darray_foreach_span(NULL, count_span, &count) != -1)
+    log_fail(Line":test_span(1): darray_foreach_span did not return -1.");
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_span(1): darray_create returned NULL.");
+  if (darray_span_next(array, &span) != 0)
+    log_fail(Line":test_span(1): empty array should have no spans.");
+  darray_destroy(&array);
+
+  /* Test 2 -- spans follow the landings, and stop at largest */
+  if ((array = prep_darray(0)) == NULL)
+    log_fail("\tby "Line":test_span(2)");
+  int * num = NULL;
+  if ((num = malloc(sizeof(int))) == NULL)
+    log_fail(Line":test_span(2): malloc returned NULL.");
+  *num = 100;
+  darray_set(array, 100, num);
+  static const int first[] = {0, 8, 24, 56};
+  static const int counts[] = {8, 16, 32, 45};
+  for (int i = 0; i < 4; i++) {
+    if (darray_span_next(array, &span) != 1
+	|| span.first != first[i] || span.count != counts[i])
+      log_fail(Line":test_span(2): wrong span.");
+    if (span.base[span.count - 1] != darray_get(array, span.first
+						+ span.count - 1))
+      log_fail(Line":test_span(2): span disagrees with darray_get.");
+  }
+  if (darray_span_next(array, &span) != 0)
+    log_fail(Line":test_span(2): too many spans.");
+
+  /* Test 3 -- darray_foreach_span visits every slot */
+  count = 0;
+  if (darray_foreach_span(array, count_span, &count) != 0 || count != 101)
+    log_fail(Line":test_span(3): should have visited 101 slots.");
+
+  /* Test 4 -- darray_foreach_nonnull visits every element */
+  count = 0;
+  if (darray_foreach_nonnull(array, count_nonnull, &count) != 0
+      || count != 11)
+    log_fail(Line":test_span(4): should have visited 11 elements.");
+
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_bulk
+ *
+ * DESCRIPTION:	    Tests the darray_push(), darray_append_range(),
+ *		    darray_fill() and darray_copy_out() functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_bulk() {
+
+  static int nums[1000];
+  static void * src[1000];
+  static void * dst[1200];
+  darray * array = NULL;
+
+  /* Test 1 -- push onto an empty array */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_bulk(1): darray_create returned NULL.");
+  for (int i = 0; i < 3; i++) {
+    if (darray_push(array, &nums[i]) != i)
+      log_fail(Line":test_bulk(1): darray_push returned the wrong index.");
+  }
+  if (darray_push(array, NULL) != -1)
+    log_fail(Line":test_bulk(1): pushing NULL should fail.");
+
+  /* Test 2 -- append_range across several landings, trailing NULLs */
+  for (int i = 0; i < 1000; i++)
+    src[i] = (i < 990 && i % 3) ? &nums[i] : NULL;
+  if (darray_append_range(array, src, 1000) != 3)
+    log_fail(Line":test_bulk(2): darray_append_range should return 3.");
+  if (darray_largest(array) != 3 + 989)
+    log_fail(Line":test_bulk(2): largest should be 992.");
+  for (int i = 0; i < 1000; i++) {
+    if (darray_get(array, i + 3) != src[i])
+      log_fail(Line":test_bulk(2): element disagrees with source.");
+  }
+  int size = darray_size(array);
+
+  /* Test 3 -- fill overwrites a range */
+  if (darray_fill(array, 5, 500, &nums[0]) != 0)
+    log_fail(Line":test_bulk(3): darray_fill did not return 0.");
+  for (int i = 5; i < 500; i++) {
+    if (darray_get(array, i) != &nums[0])
+      log_fail(Line":test_bulk(3): element was not filled.");
+  }
+  if (darray_size(array) != size + 165 || darray_get(array, 500) != src[497])
+    log_fail(Line":test_bulk(3): fill went out of bounds.");
+
+  /* Test 4 -- clearing the tail moves largest down */
+  if (darray_fill(array, 900, 2000, NULL) != 0)
+    log_fail(Line":test_bulk(4): darray_fill did not return 0.");
+  if (darray_largest(array) != 899)
+    log_fail(Line":test_bulk(4): largest should be 899.");
+
+  /* Test 5 -- copy_out agrees with get, past the end of the array */
+  if (darray_copy_out(array, 0, 1200, dst) != 0)
+    log_fail(Line":test_bulk(5): darray_copy_out did not return 0.");
+  for (int i = 0; i < 1200; i++) {
+    if (dst[i] != darray_get(array, i))
+      log_fail(Line":test_bulk(5): disagrees with darray_get.");
+  }
+
+  darray_destroy(&array);
+
+  /* Test 6 -- a failed append or fill releases the landings it allocated */
+  size_t bytes[2] = { 0, (size_t)-1 };
+  const darray_allocator limit = {
+    .alloc = count_alloc,
+    .zalloc = limit_zalloc,
+    .free = count_free,
+    .ctx = bytes
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.allocator = &limit;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_bulk(6): darray_create_ex returned NULL.");
+  for (int i = 0; i < 3; i++)
+    darray_push(array, &nums[i]);
+  size_t before = bytes[0];
+  bytes[1] = before + 1024;
+  if (darray_append_range(array, src, 1000) != -1
+      || darray_fill(array, 3, 1003, &nums[0]) != -1)
+    log_fail(Line":test_bulk(6): the allocation should fail.");
+  if (bytes[0] != before || darray_size(array) != 3
+      || darray_largest(array) != 2 || darray_get(array, 3) != NULL)
+    log_fail(Line":test_bulk(6): the array should be unchanged.");
+  bytes[1] = (size_t)-1;
+  if (darray_append_range(array, src, 1000) != 3)
+    log_fail(Line":test_bulk(6): darray_append_range should return 3.");
+  darray_destroy(&array);
+  if (bytes[0] != 0)
+    log_fail(Line":test_bulk(6): landings were leaked.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_contract
+ *
+ * DESCRIPTION:	    Tests that darray_set() maintains the size and largest
+ *		    index of the array, and releases trailing landings.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_contract() {
+
+  static int nums[9];
+  darray * array = NULL;
+
+  /* Test 1 -- overwriting does not change the size */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_contract(1): darray_create returned NULL.");
+  for (int i = 0; i < 9; i++)
+    darray_push(array, &nums[i]);
+  darray_set(array, 3, &nums[0]);
+  darray_set(array, 4, NULL);
+  darray_set(array, 4, NULL);
+  if (darray_size(array) != 8 || darray_landings(array) != 2)
+    log_fail(Line":test_contract(1): size should be 8, with 2 landings.");
+
+  /* Test 2 -- clearing largest keeps one spare landing */
+  darray_set(array, 8, NULL);
+  if (darray_largest(array) != 7 || darray_landings(array) != 2)
+    log_fail(Line":test_contract(2): largest should be 7, with 2 landings.");
+  darray_set(array, 8, &nums[8]);
+  darray_set(array, 8, NULL);
+  if (darray_landings(array) != 2)
+    log_fail(Line":test_contract(2): should have kept the spare landing.");
+
+  /* Test 3 -- without spares, trailing landings are released */
+  if (darray_set_spare(array, 0) != 0 || darray_landings(array) != 1)
+    log_fail(Line":test_contract(3): should have 1 landing.");
+  darray_set(array, 100, &nums[0]);
+  darray_set(array, 100, NULL);
+  if (darray_largest(array) != 7 || darray_landings(array) != 1)
+    log_fail(Line":test_contract(3): largest should be 7, with 1 landing.");
+
+  /* Test 4 -- clearing everything empties the array */
+  for (int i = 7; i >= 0; i--)
+    darray_set(array, i, NULL);
+  if (darray_size(array) != 0 || darray_largest(array) != 0
+      || darray_landings(array) != 0)
+    log_fail(Line":test_contract(4): array should be empty.");
+  if (darray_push(array, &nums[1]) != 0 || darray_get(array, 0) != &nums[1])
+    log_fail(Line":test_contract(4): should be able to push again.");
+
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_create_ex
+ *
+ * DESCRIPTION:	    Tests the darray_create_ex() function, and that arrays
+ *		    with other landing geometries behave like the default.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_create_ex() {
+
+  static int nums[5000];
+  static const int geometry[][2] = {{1, 1}, {8, 1}, {4096, 1}, {2, 2},
+				    {16, 3}, {1, 8}};
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  darray * array = NULL;
+
+  /* Test 1 -- invalid geometries */
+  config.first = 12;
+  if ((array = darray_create_ex(&config)) != NULL)
+    log_fail(Line":test_create_ex(1): first must be a power of two.");
+  config.first = 8;
+  config.shift = 0;
+  if ((array = darray_create_ex(&config)) != NULL)
+    log_fail(Line":test_create_ex(1): shift must be at least 1.");
+
+  /* Test 2 -- NULL means the defaults */
+  if ((array = darray_create_ex(NULL)) == NULL)
+    log_fail(Line":test_create_ex(2): darray_create_ex returned NULL.");
+  darray_set(array, 8, &nums[0]);
+  if (darray_landings(array) != 2 || darray_capacity(array) != 24)
+    log_fail(Line":test_create_ex(2): should have 2 landings, 24 slots.");
+  darray_destroy(&array);
+
+  /* Test 3 -- every geometry stores and spans the same elements */
+  for (size_t g = 0; g < sizeof(geometry) / sizeof(geometry[0]); g++) {
+    config.first = geometry[g][0];
+    config.shift = geometry[g][1];
+    if ((array = darray_create_ex(&config)) == NULL)
+      log_fail(Line":test_create_ex(3): darray_create_ex returned NULL.");
+    for (int i = 0; i < 5000; i += 7)
+      darray_set(array, i, &nums[i]);
+    for (int i = 0; i < 5000; i++) {
+      if (darray_get(array, i) != (i % 7 ? NULL : &nums[i]))
+	log_fail(Line":test_create_ex(3): element disagrees.");
     }
-    if (random)
-      *pNum = rand() % 10;
-    else
-      *pNum = tmp[i];
-    darray_set(array, i, (void *)pNum);
+
+    long long capacity = 0;
+    for (int n = 0; n < darray_landings(array); n++)
+      capacity += darray_landing_size(array, n);
+    if (darray_capacity(array) != capacity)
+      log_fail(Line":test_create_ex(3): wrong capacity.");
+
+    int count = 0;
+    if (darray_foreach_span(array, count_span, &count) != 0
+	|| count != darray_largest(array) + 1)
+      log_fail(Line":test_create_ex(3): spans should cover the array.");
+    darray_destroy(&array);
   }
 
-  if (darray_size(array) <= 0) {
-    log(Line":prep_darray: darray_size is <= 0\n");
-    return NULL;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_allocator
+ *
+ * DESCRIPTION:	    Tests that arrays allocate through the allocator they are
+ *		    given, and the darray_arena_*() functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_allocator() {
+
+  static int nums[100];
+  size_t outstanding = 0;
+  const darray_allocator counter = {
+    .alloc = count_alloc,
+    .zalloc = count_zalloc,
+    .free = count_free,
+    .ctx = &outstanding
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  darray_statistics st;
+  darray * array = NULL;
+
+  /* Test 1 -- every allocation is returned to the allocator */
+  config.allocator = &counter;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_allocator(1): darray_create_ex returned NULL.");
+  for (int i = 0; i < 100; i++)
+    darray_set(array, i * 10, &nums[i]);
+  if (darray_stats(array, &st) || outstanding != st.bytes
+      || st.slots != darray_capacity(array))
+    log_fail(Line":test_allocator(1): allocations were not counted.");
+  darray_set(array, 990, NULL);
+  darray_set_spare(array, 0);
+  if (darray_stats(array, &st) || outstanding != st.bytes
+      || st.slots != darray_capacity(array))
+    log_fail(Line":test_allocator(1): frees were not counted.");
+  darray_destroy(&array);
+  if (outstanding != 0)
+    log_fail(Line":test_allocator(1): memory was leaked.");
+
+  /* Test 2 -- arrays built in an arena, then released by a reset */
+  darray_arena * arena = NULL;
+  darray * arrays[32];
+  if ((arena = darray_arena_create(1024)) == NULL)
+    log_fail(Line":test_allocator(2): darray_arena_create returned NULL.");
+  config.allocator = darray_arena_allocator(arena);
+  for (int round = 0; round < 2; round++) {
+    for (int a = 0; a < 32; a++) {
+      if ((arrays[a] = darray_create_ex(&config)) == NULL)
+	log_fail(Line":test_allocator(2): darray_create_ex returned NULL.");
+      for (int i = 0; i < a * 4; i++)
+	darray_set(arrays[a], i, &nums[a]);
+    }
+    for (int a = 0; a < 32; a++) {
+      for (int i = 0; i <= a * 4; i++) {
+	if (darray_get(arrays[a], i) != (i < a * 4 ? &nums[a] : NULL))
+	  log_fail(Line":test_allocator(2): arrays overlap in the arena.");
+      }
+    }
+    darray_arena_reset(arena);
   }
+  darray_arena_destroy(&arena);
+  if (arena != NULL)
+    log_fail(Line":test_allocator(2): pointer should now be NULL.");
 
-  return array;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_values
+ *
+ * DESCRIPTION:	    Tests the functions generated by DARRAY_DEFINE(), which
+ *		    store values inline.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_values() {
+
+  record_array * array = NULL;
+  record r = {0};
+
+  /* Test 1 -- unset elements are zero */
+  if ((array = record_array_create(count_destroy)) == NULL)
+    log_fail(Line":test_values(1): record_array_create returned NULL.");
+  r = record_array_get(array, 5);
+  if (r.key != 0 || r.flags != 0 || r.weight != 0.0)
+    log_fail(Line":test_values(1): should be zero.");
+
+  /* Test 2 -- values are copied in and out */
+  for (int i = 0; i < 300; i++) {
+    r = (record){ .key = i + 1, .flags = i & 7, .weight = i / 2.0 };
+    if (record_array_set(array, i, r) != 0)
+      log_fail(Line":test_values(2): record_array_set did not return 0.");
+  }
+  for (int i = 0; i < 300; i++) {
+    r = record_array_get(array, i);
+    if (r.key != i + 1 || r.flags != (i & 7) || r.weight != i / 2.0)
+      log_fail(Line":test_values(2): wrong value.");
+  }
+  if (darray_size(array) != 300 || darray_largest(array) != 299)
+    log_fail(Line":test_values(2): size should be 300.");
+
+  /* Test 3 -- writes through the pointer are seen by get, and spans */
+  record * p = NULL;
+  if ((p = record_array_ptr(array, 1000)) == NULL)
+    log_fail(Line":test_values(3): record_array_ptr returned NULL.");
+  p->key = 77;
+  if (record_array_get(array, 1000).key != 77
+      || darray_largest(array) != 1000)
+    log_fail(Line":test_values(3): write through the pointer was lost.");
+  darray_span span = DARRAY_SPAN_INIT;
+  while (darray_span_next(array, &span) == 1) {
+    for (int i = 0; i < span.count; i++) {
+      if (((record *)span.base)[i].key
+	  != record_array_get(array, span.first + i).key)
+	log_fail(Line":test_values(3): span disagrees with get.");
+    }
+  }
+  if (darray_retrack(array) != 0 || array->untracked != 0
+      || darray_size(array) != 301 || darray_next(array, 299) != 1000)
+    log_fail(Line":test_values(3): darray_retrack did not count the write.");
+
+  /* Test 4 -- clearing the largest element contracts the array */
+  record_array_set(array, 1000, (record){0});
+  if (darray_largest(array) != 299)
+    log_fail(Line":test_values(4): largest should be 299.");
+
+  /* Test 5 -- the pointer functions refuse an array of values */
+  long long size = darray_size(array);
+  void * ptrs[4] = {&r, &r, &r, &r};
+  int idx[2] = {0, 1};
+  darray_cursor cursor = DARRAY_CURSOR_INIT;
+  if (darray_get(array, 0) != NULL || darray_get64(array, 0) != NULL
+      || darray_cursor_get(array, &cursor, 0) != NULL)
+    log_fail(Line":test_values(5): get should return NULL.");
+  if (darray_set(array, 0, &r) != -1 || darray_set64(array, 0, &r) != -1
+      || darray_push(array, &r) != -1)
+    log_fail(Line":test_values(5): set and push should return -1.");
+  if (darray_get_many(array, idx, ptrs, 2) != -1
+      || darray_set_many(array, idx, ptrs, 2) != -1
+      || darray_append_range(array, ptrs, 4) != -1
+      || darray_fill(array, 0, 4, &r) != -1
+      || darray_copy_out(array, 0, 4, ptrs) != -1
+      || darray_foreach_nonnull(array, count_nonnull, idx) != -1)
+    log_fail(Line":test_values(5): bulk functions should return -1.");
+  if (ptrs[0] != &r || darray_size(array) != size
+      || record_array_get(array, 0).key != 1
+      || record_array_get(array, 1).key != 2)
+    log_fail(Line":test_values(5): values should be unchanged.");
+
+  /* Test 6 -- destroy is called on each non-empty element */
+  destroyed = 0;
+  record_array_destroy(&array);
+  if (destroyed != 300 || array != NULL)
+    log_fail(Line":test_values(6): destroy should be called 300 times.");
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_concurrent
+ *
+ * DESCRIPTION:	    Tests darray_exchange() and darray_cas(), and concurrent
+ *		    darray_push() and darray_get() from several threads.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define PUSH_THREADS 8
+#define PUSH_COUNT 5000
+static int test_concurrent() {
+
+  static int nums[PUSH_THREADS * PUSH_COUNT];
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  darray * array = NULL;
+
+  /* Test 1 -- exchange and cas */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_concurrent(1): darray_create returned NULL.");
+  if (darray_exchange(array, 20, &nums[0]) != NULL
+      || darray_exchange(array, 20, &nums[1]) != &nums[0])
+    log_fail(Line":test_concurrent(1): wrong result from exchange.");
+  if (darray_cas(array, 20, &nums[0], &nums[2]) != 0
+      || darray_get(array, 20) != &nums[1])
+    log_fail(Line":test_concurrent(1): cas should have failed.");
+  if (darray_cas(array, 20, &nums[1], &nums[2]) != 1
+      || darray_get(array, 20) != &nums[2])
+    log_fail(Line":test_concurrent(1): cas should have succeeded.");
+  if (darray_cas(array, 20, &nums[2], NULL) != 1
+      || darray_size(array) != 0 || darray_largest(array) != 0)
+    log_fail(Line":test_concurrent(1): array should be empty.");
+  darray_destroy(&array);
+
+  /* Test 2 -- many threads pushing while the main thread reads */
+  config.concurrent = 1;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_concurrent(2): darray_create_ex returned NULL.");
+  pthread_t threads[PUSH_THREADS];
+  void * args[PUSH_THREADS][2];
+  for (int t = 0; t < PUSH_THREADS; t++) {
+    args[t][0] = array;
+    args[t][1] = &nums[t * PUSH_COUNT];
+    if (pthread_create(&threads[t], NULL, push_worker, args[t]))
+      log_fail(Line":test_concurrent(2): pthread_create failed.");
+  }
+  int seen = 0;
+  while (seen < PUSH_THREADS * PUSH_COUNT) {
+    void * data = darray_get(array, seen);
+    if (data != NULL) {
+      if ((int *)data < nums
+	  || (int *)data >= nums + PUSH_THREADS * PUSH_COUNT)
+	log_fail(Line":test_concurrent(2): read a bad element.");
+      seen++;
+    }
+  }
+  for (int t = 0; t < PUSH_THREADS; t++)
+    pthread_join(threads[t], NULL);
+
+  /* Test 3 -- every element landed exactly once */
+  if (darray_size(array) != PUSH_THREADS * PUSH_COUNT
+      || darray_largest(array) != PUSH_THREADS * PUSH_COUNT - 1)
+    log_fail(Line":test_concurrent(3): wrong size or largest.");
+  for (int i = 0; i < PUSH_THREADS * PUSH_COUNT; i++) {
+    int * data = darray_get(array, i);
+    if (data == NULL || *data != 0)
+      log_fail(Line":test_concurrent(3): element pushed twice.");
+    *data = 1;
+  }
+
+  /* Test 4 -- the functions which would skip the atomics refuse the array,
+   * and leave it as it was
+   */
+  int other = 0;
+  void * src[2] = {&other, &other};
+  long long largest = darray_largest(array);
+  if (darray_fill(array, 0, 10, &other) != -1
+      || darray_fill(array, largest + 1, largest + 200000, &other) != -1
+      || darray_append_range(array, src, 2) != -1
+      || darray_set_value(array, 0, &src[0]) != -1
+      || darray_slot(array, largest + 200000, 1) != NULL
+      || darray_slot(array, 0, 0) == NULL)
+    log_fail(Line":test_concurrent(4): should refuse the array.");
+  if (darray_largest(array) != largest || darray_get(array, 0) == &other
+      || darray_size(array) != PUSH_THREADS * PUSH_COUNT)
+    log_fail(Line":test_concurrent(4): the array was changed.");
+  darray_destroy(&array);
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_cursor
+ *
+ * DESCRIPTION:	    Tests the darray_cursor_get() function against
+ *		    darray_get(), with several access patterns.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_cursor() {
+
+  static int nums[1000];
+  darray * array = NULL;
+  darray_cursor cursor = DARRAY_CURSOR_INIT;
+
+  /* Test 1 -- empty array */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_cursor(1): darray_create returned NULL.");
+  if (darray_cursor_get(array, &cursor, 0) != NULL)
+    log_fail(Line":test_cursor(1): should be NULL.");
+  for (int i = 0; i < 1000; i += 3)
+    darray_set(array, i, &nums[i]);
+
+  /* Test 2 -- forward, reverse and random scans */
+  for (int i = -1; i < 1100; i++) {
+    if (darray_cursor_get(array, &cursor, i) != darray_get(array, i))
+      log_fail(Line":test_cursor(2): forward scan disagrees.");
+  }
+  for (int i = 1100; i >= -1; i--) {
+    if (darray_cursor_get(array, &cursor, i) != darray_get(array, i))
+      log_fail(Line":test_cursor(2): reverse scan disagrees.");
+  }
+  for (int i = 0; i < 1000; i++) {
+    int index = rand() % 1100;
+    if (darray_cursor_get(array, &cursor, index) != darray_get(array, index))
+      log_fail(Line":test_cursor(2): random scan disagrees.");
+  }
+
+  /* Test 3 -- the cursor respects largest */
+  darray_cursor_get(array, &cursor, 996);
+  darray_set(array, 999, NULL);
+  if (darray_cursor_get(array, &cursor, 999) != NULL)
+    log_fail(Line":test_cursor(3): should be NULL past largest.");
+
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_parallel
+ *
+ * DESCRIPTION:	    Tests the darray_parallel_foreach() and
+ *		    darray_parallel_reduce() functions against a serial sum.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define PARALLEL_COUNT 300000
+static int test_parallel() {
+
+  static int nums[PARALLEL_COUNT];
+  darray * array = NULL;
+  darray_pool * pool = NULL;
+  long long expected = 0;
+
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_parallel: darray_create returned NULL.");
+  for (int i = 0; i < PARALLEL_COUNT; i++) {
+    nums[i] = rand() % 1000;
+    if (i % 5)
+      darray_set(array, i, &nums[i]);
+    expected += i % 5 ? nums[i] : 0;
+  }
+
+  for (int threads = 0; threads <= 4; threads++) {
+    /* Test 1 -- pool creation (NULL pool means the calling thread) */
+    if (threads > 0 && (pool = darray_pool_create(threads)) == NULL)
+      log_fail(Line":test_parallel(1): darray_pool_create returned NULL.");
+
+    /* Test 2 -- foreach visits every slot exactly once */
+    long long slots = 0;
+    if (darray_parallel_foreach(array, pool, count_slots, &slots) != 0
+	|| slots != darray_largest(array) + 1)
+      log_fail(Line":test_parallel(2): should visit every slot.");
+
+    /* Test 3 -- reduce agrees with the serial sum */
+    long long sum = 0;
+    if (darray_parallel_reduce(array, pool, sum_fold, sum_combine, &sum,
+			       sizeof(sum), NULL) != 0
+	|| sum != expected)
+      log_fail(Line":test_parallel(3): wrong sum.");
+
+    darray_pool_destroy(&pool);
+  }
+
+  /* Test 4 -- writes made by foreach are not seen by a clone */
+  darray * snap = NULL;
+  long long sum = 0;
+  if ((snap = darray_clone(array)) == NULL
+      || (pool = darray_pool_create(4)) == NULL)
+    log_fail(Line":test_parallel(4): darray_clone returned NULL.");
+  if (darray_parallel_foreach(snap, pool, clear_slots, NULL) != 0
+      || darray_get(snap, 1) != NULL
+      || darray_get(snap, PARALLEL_COUNT - 1) != NULL)
+    log_fail(Line":test_parallel(4): foreach should clear every slot.");
+  if (darray_parallel_reduce(array, pool, sum_fold, sum_combine, &sum,
+			     sizeof(sum), NULL) != 0
+      || sum != expected)
+    log_fail(Line":test_parallel(4): a write was seen by the other array.");
+  darray_pool_destroy(&pool);
+  darray_destroy(&snap);
+
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_slots
+ *
+ * DESCRIPTION:	    Callback for darray_parallel_foreach() which atomically
+ *		    adds the length of each run to the count at `ctx'.
+ *
+ * ARGUMENTS:	    base: (void **) -- Unused.
+ *		    first: (long long) -- Unused.
+ *		    count: (int) -- The length of the run.
+ *		    ctx: (void *) -- Pointer to the count (long long).
+ *
+ * RETURN:	    int -- 0, to continue.
+ *
+ * NOTES:	    none.
+ ***/
+static int count_slots(void ** base, long long first, int count,
+		       void * ctx)
+{
+  (void)base;
+  (void)first;
+  __atomic_fetch_add((long long *)ctx, count, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    clear_slots
+ *
+ * DESCRIPTION:	    Callback for darray_parallel_foreach() which writes NULL
+ *		    to every slot of each run.
+ *
+ * ARGUMENTS:	    base: (void **) -- The run of slots.
+ *		    first: (long long) -- Unused.
+ *		    count: (int) -- The length of the run.
+ *		    ctx: (void *) -- Unused.
+ *
+ * RETURN:	    int -- 0, to continue.
+ *
+ * NOTES:	    none.
+ ***/
+static int clear_slots(void ** base, long long first, int count,
+		       void * ctx)
+{
+  (void)first;
+  (void)ctx;
+  memset(base, 0, count * sizeof(void *));
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    sum_fold
+ *
+ * DESCRIPTION:	    Fold function for darray_parallel_reduce() which sums the
+ *		    ints pointed to by a run of slots.
+ *
+ * ARGUMENTS:	    acc: (void *) -- Pointer to the partial sum (long long).
+ *		    base: (void **) -- The run of slots.
+ *		    first: (long long) -- Unused.
+ *		    count: (int) -- The length of the run.
+ *		    ctx: (void *) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void sum_fold(void * acc, void ** base, long long first, int count,
+		     void * ctx)
+{
+  (void)first;
+  (void)ctx;
+  for (int i = 0; i < count; i++) {
+    if (base[i] != NULL)
+      *(long long *)acc += *(int *)base[i];
+  }
+}
+
+/******************************************************************************
+ * FUNCTION:	    sum_combine
+ *
+ * DESCRIPTION:	    Combine function for darray_parallel_reduce() which adds
+ *		    a partial sum.
+ *
+ * ARGUMENTS:	    acc: (void *) -- Pointer to the sum (long long).
+ *		    part: (const void *) -- Pointer to the partial sum.
+ *		    ctx: (void *) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void sum_combine(void * acc, const void * part, void * ctx)
+{
+  (void)ctx;
+  *(long long *)acc += *(const long long *)part;
+}
+
+/******************************************************************************
+ * FUNCTION:	    push_worker
+ *
+ * DESCRIPTION:	    Thread which pushes PUSH_COUNT consecutive ints onto a
+ *		    concurrent array.
+ *
+ * ARGUMENTS:	    arg: (void *) -- Pointer to two pointers: the array, and
+ *			the first int to push.
+ *
+ * RETURN:	    void * -- NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * push_worker(void * arg)
+{
+  darray * array = ((void **)arg)[0];
+  int * nums = ((void **)arg)[1];
+  for (int i = 0; i < PUSH_COUNT; i++)
+    darray_push(array, &nums[i]);
+  return NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    write_worker
+ *
+ * DESCRIPTION:	    Thread which streams an array with darray_write(), then
+ *		    closes the file descriptor.
+ *
+ * ARGUMENTS:	    arg: (void *) -- Pointer to three pointers: the array, the
+ *			file descriptor, and the codec.
+ *
+ * RETURN:	    void * -- NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * write_worker(void * arg)
+{
+  darray * array = ((void **)arg)[0];
+  int * fd = ((void **)arg)[1];
+  const darray_codec * codec = ((void **)arg)[2];
+  /* A failed write shows up as a failed read on the other end */
+  darray_write(array, *fd, codec);
+  close(*fd);
+  return NULL;
+}
+
+/******************************************************************************
+ * FUNCTION:	    encode_int
+ *
+ * DESCRIPTION:	    Codec function which encodes an int as one more than its
+ *		    value, so that 0 is not taken for NULL.
+ *
+ * ARGUMENTS:	    data: (void *) -- Pointer to the int.
+ *		    buf: (void *) -- Receives the encoding.
+ *		    ctx: (void *) -- Unused.
+ *
+ * RETURN:	    int -- 0.
+ *
+ * NOTES:	    none.
+ ***/
+static int encode_int(void * data, void * buf, void * ctx)
+{
+  (void)ctx;
+  int value = *(int *)data + 1;
+  memcpy(buf, &value, sizeof(int));
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    decode_int
+ *
+ * DESCRIPTION:	    Codec function which reverses encode_int() into a new int.
+ *
+ * ARGUMENTS:	    buf: (const void *) -- The encoding.
+ *		    ctx: (void *) -- Unused.
+ *
+ * RETURN:	    void * -- Pointer to the new int, to be freed by the caller.
+ *
+ * NOTES:	    none.
+ ***/
+static void * decode_int(const void * buf, void * ctx)
+{
+  (void)ctx;
+  int * value = malloc(sizeof(int));
+  if (value != NULL) {
+    memcpy(value, buf, sizeof(int));
+    (*value)--;
+  }
+  return value;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_destroy
+ *
+ * DESCRIPTION:	    Destroy function which counts its calls in `destroyed'.
+ *
+ * ARGUMENTS:	    data: (void *) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void count_destroy(void * data)
+{
+  (void)data;
+  destroyed++;
+}
+
+/******************************************************************************
+ * FUNCTION:	    free_destroy
+ *
+ * DESCRIPTION:	    Destroy function which frees `data', and counts its calls
+ *		    in `destroyed'.
+ *
+ * ARGUMENTS:	    data: (void *) -- The element to free.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void free_destroy(void * data)
+{
+  free(data);
+  destroyed++;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_reclaim
+ *
+ * DESCRIPTION:	    Destroy function which atomically counts its calls in
+ *		    `reclaimed', for arrays destroyed on another thread.
+ *
+ * ARGUMENTS:	    data: (void *) -- Unused.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void count_reclaim(void * data)
+{
+  (void)data;
+  __atomic_add_fetch(&reclaimed, 1, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_alloc
+ *
+ * DESCRIPTION:	    Allocator hook which adds each request to the count of
+ *		    outstanding bytes pointed to by `ctx'.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Pointer to the count (size_t).
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * count_alloc(void * ctx, size_t size)
+{
+  *(size_t *)ctx += size;
+  return malloc(size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_zalloc
+ *
+ * DESCRIPTION:	    As count_alloc(), but the memory is zeroed.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Pointer to the count (size_t).
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * count_zalloc(void * ctx, size_t size)
+{
+  *(size_t *)ctx += size;
+  return calloc(1, size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    limit_zalloc
+ *
+ * DESCRIPTION:	    As count_zalloc(), but fails any request which would take
+ *		    the count past a limit.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Pointer to the count and the limit
+ *			(size_t[2]).
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * limit_zalloc(void * ctx, size_t size)
+{
+  size_t * bytes = ctx;
+  if (size > bytes[1] - bytes[0])
+    return NULL;
+  return count_zalloc(ctx, size);
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_free
+ *
+ * DESCRIPTION:	    Allocator hook which subtracts each release from the count
+ *		    of outstanding bytes pointed to by `ctx'.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Pointer to the count (size_t).
+ *		    ptr: (void *) -- The memory to free.
+ *		    size: (size_t) -- The size of the memory.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void count_free(void * ctx, void * ptr, size_t size)
+{
+  *(size_t *)ctx -= size;
+  free(ptr);
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_reclaim
+ *
+ * DESCRIPTION:	    Tests the darray_destroy_step() and darray_destroy_async()
+ *		    functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define RECLAIM_COUNT 20000
+static int test_reclaim() {
+
+  static int nums[RECLAIM_COUNT];
+  darray * array = NULL;
+
+  /* Test 1 -- stepping takes several calls, and visits every element */
+  if ((array = darray_create(count_destroy)) == NULL)
+    log_fail(Line":test_reclaim(1): darray_create returned NULL.");
+  for (int i = 0; i < RECLAIM_COUNT; i += 3)
+    darray_set(array, i, &nums[i]);
+  destroyed = 0;
+  int steps = 0;
+  while (darray_destroy_step(&array, 1000))
+    steps++;
+  if (array != NULL || steps < RECLAIM_COUNT / 1000
+      || destroyed != (RECLAIM_COUNT + 2) / 3)
+    log_fail(Line":test_reclaim(1): should destroy in bounded steps.");
+
+  /* Test 2 -- an empty array is destroyed in a single step */
+  if ((array = darray_create(count_destroy)) == NULL)
+    log_fail(Line":test_reclaim(2): darray_create returned NULL.");
+  if (darray_destroy_step(&array, 100) != 0 || array != NULL)
+    log_fail(Line":test_reclaim(2): should finish at once.");
+
+  /* Test 3 -- the background thread visits every element */
+  if ((array = darray_create(count_reclaim)) == NULL)
+    log_fail(Line":test_reclaim(3): darray_create returned NULL.");
+  for (int i = 0; i < RECLAIM_COUNT; i++)
+    darray_set(array, i, &nums[i]);
+  if (darray_destroy_async(&array) != 0 || array != NULL)
+    log_fail(Line":test_reclaim(3): darray_destroy_async failed.");
+  for (int i = 0; i < 10000
+	 && __atomic_load_n(&reclaimed, __ATOMIC_RELAXED) < RECLAIM_COUNT;
+       i++)
+    usleep(1000);
+  if (__atomic_load_n(&reclaimed, __ATOMIC_RELAXED) != RECLAIM_COUNT)
+    log_fail(Line":test_reclaim(3): should destroy every element.");
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_sparse
+ *
+ * DESCRIPTION:	    Tests that a sparse array only allocates the pages which
+ *		    are written.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_sparse() {
+
+  static int nums[4];
+  static const int idx[4] = {3, 70000, 5000000, 100000000};
+  size_t outstanding = 0;
+  const darray_allocator counter = {
+    .alloc = count_alloc,
+    .zalloc = count_zalloc,
+    .free = count_free,
+    .ctx = &outstanding
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  darray * array = NULL;
+
+  /* Test 1 -- bad page sizes, and concurrent sparse arrays, are refused */
+  config.page = 3;
+  if (darray_create_ex(&config) != NULL)
+    log_fail(Line":test_sparse(1): page must be a power of two.");
+  config.page = 1024;
+  config.concurrent = 1;
+  if (darray_create_ex(&config) != NULL)
+    log_fail(Line":test_sparse(1): sparse arrays cannot be concurrent.");
+  config.concurrent = 0;
+
+  /* Test 2 -- a far index costs one page and its page table */
+  config.allocator = &counter;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_sparse(2): darray_create_ex returned NULL.");
+  if (darray_set(array, idx[3], &nums[3]) != 0
+      || darray_get(array, idx[3]) != &nums[3]
+      || darray_largest(array) != idx[3] || darray_size(array) != 1)
+    log_fail(Line":test_sparse(2): far index was not set.");
+  if (outstanding > sizeof(darray) + (1 << 20))
+    log_fail(Line":test_sparse(2): intermediate landings were allocated.");
+
+  /* Test 3 -- reads of untouched pages allocate nothing */
+  size_t before = outstanding;
+  darray_cursor cursor = DARRAY_CURSOR_INIT;
+  if (darray_get(array, idx[3] - 5000) != NULL
+      || darray_get(array, 50000000) != NULL
+      || darray_cursor_get(array, &cursor, 60000000) != NULL
+      || darray_slot(array, 40000000, 0) != NULL
+      || outstanding != before)
+    log_fail(Line":test_sparse(3): untouched pages should read NULL.");
+
+  /* Test 4 -- iteration visits only the pages which were written */
+  for (int i = 0; i < 3; i++)
+    darray_set(array, idx[i], &nums[i]);
+  darray_span span = DARRAY_SPAN_INIT;
+  int found = 0, spans = 0;
+  while (darray_span_next(array, &span) == 1) {
+    spans++;
+    for (int i = 0; i < span.count; i++) {
+      if (span.base[i] != NULL
+	  && (found >= 4 || span.first + i != idx[found++]))
+	log_fail(Line":test_sparse(4): wrong element visited.");
+    }
+  }
+  if (found != 4 || spans > 5)
+    log_fail(Line":test_sparse(4): should visit only the written pages.");
+
+  /* Test 5 -- clearing the far index skips the gap, and releases it */
+  darray_set(array, idx[3], NULL);
+  if (darray_largest(array) != idx[2] || darray_size(array) != 3
+      || outstanding >= before)
+    log_fail(Line":test_sparse(5): far landing was not released.");
+
+  darray_destroy(&array);
+  if (outstanding != 0)
+    log_fail(Line":test_sparse(5): memory was leaked.");
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_index64
+ *
+ * DESCRIPTION:	    Tests the darray_get64() and darray_set64() functions on
+ *		    indices beyond INT_MAX, in a sparse array. (The page
+ *		    tables for indices near DARRAY_INDEX_MAX are too large to
+ *		    allocate here.)
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_index64() {
+
+  static int nums[3];
+  static const long long idx[3] = {5, 3000000000ll, (1ll << 34) + 7};
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  darray * array = NULL;
+
+  config.page = 4096;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_index64: darray_create_ex returned NULL.");
+
+  /* Test 1 -- indices beyond INT_MAX */
+  for (int i = 0; i < 3; i++) {
+    if (darray_set64(array, (size_t)idx[i], &nums[i]) != 0)
+      log_fail(Line":test_index64(1): darray_set64 failed.");
+  }
+  for (int i = 0; i < 3; i++) {
+    if (darray_get64(array, (size_t)idx[i]) != &nums[i]
+	|| darray_get64(array, (size_t)idx[i] - 1) != NULL)
+      log_fail(Line":test_index64(1): darray_get64 returned the wrong data.");
+  }
+  if (darray_largest(array) != idx[2] || darray_size(array) != 3)
+    log_fail(Line":test_index64(1): largest and size should be exact.");
+
+  /* Test 2 -- indices past DARRAY_INDEX_MAX are refused */
+  if (darray_set64(array, (size_t)DARRAY_INDEX_MAX + 1, &nums[0]) != -1
+      || darray_get64(array, (size_t)DARRAY_INDEX_MAX + 1) != NULL
+      || darray_get64(array, (size_t)-1) != NULL)
+    log_fail(Line":test_index64(2): out of range index was accepted.");
+
+  /* Test 3 -- the int API cannot push past INT_MAX */
+  if (darray_push(array, &nums[0]) != -1)
+    log_fail(Line":test_index64(3): darray_push should fail.");
+
+  /* Test 4 -- iteration reports the 64-bit indices */
+  darray_span span = DARRAY_SPAN_INIT;
+  int found = 0;
+  while (darray_span_next(array, &span) == 1) {
+    for (int i = 0; i < span.count; i++) {
+      if (span.base[i] != NULL
+	  && (found >= 3 || span.first + i != idx[found++]))
+	log_fail(Line":test_index64(4): wrong element visited.");
+    }
+  }
+  if (found != 3)
+    log_fail(Line":test_index64(4): should visit every element.");
+
+  /* Test 5 -- clearing the largest element settles across the gap */
+  darray_set64(array, (size_t)idx[2], NULL);
+  if (darray_largest(array) != idx[1])
+    log_fail(Line":test_index64(5): largest was not settled.");
+  darray_destroy(&array);
+
+  /* Test 6 -- offsets within a landing beyond INT_MAX, on a paged array and
+   * on a dense one (whose landings are mapped lazily, and never touched)
+   */
+  static const long long far[2] = {(1ll << 32) + (1ll << 31) + 5,
+				   5000000000000ll};
+  const darray_allocator lazy = {
+    .alloc = lazy_alloc,
+    .zalloc = lazy_alloc,
+    .free = lazy_free,
+    .ctx = NULL
+  };
+  config.page = 1 << 16;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_index64(6): darray_create_ex returned NULL.");
+  for (int i = 0; i < 2; i++) {
+    if (darray_set64(array, (size_t)far[i], &nums[i]) != 0
+	|| darray_get64(array, (size_t)far[i]) != &nums[i])
+      log_fail(Line":test_index64(6): a paged offset was truncated.");
+  }
+  darray_destroy(&array);
+
+  config.page = 0;
+  config.allocator = &lazy;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_index64(6): darray_create_ex returned NULL.");
+  if (darray_set64(array, (size_t)far[0], &nums[0]) != 0
+      || darray_get64(array, (size_t)far[0]) != &nums[0]
+      || darray_get64(array, (size_t)far[0] - 1) != NULL)
+    log_fail(Line":test_index64(6): a dense offset was truncated.");
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_file
+ *
+ * DESCRIPTION:	    Tests the darray_save() and darray_map() functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define FILE_COUNT 5000
+static int test_file() {
+
+  char path[] = "/tmp/darray_test_XXXXXX";
+  record_array * array = NULL;
+  record_array * mapped = NULL;
+  int fd = -1;
+
+  if ((fd = mkstemp(path)) < 0)
+    log_fail(Line":test_file: mkstemp failed.");
+  close(fd);
+
+  /* Test 1 -- arrays of pointers cannot be saved */
+  darray * pointers = NULL;
+  if ((pointers = darray_create(NULL)) == NULL)
+    log_fail(Line":test_file(1): darray_create returned NULL.");
+  darray_set(pointers, 0, &fd);
+  if (darray_save(pointers, path) != -1)
+    log_fail(Line":test_file(1): should refuse an array of pointers.");
+  darray_destroy(&pointers);
+
+  /* Test 2 -- a saved array maps back read-only with the same contents */
+  if ((array = record_array_create(NULL)) == NULL)
+    log_fail(Line":test_file(2): record_array_create returned NULL.");
+  for (int i = 0; i < FILE_COUNT; i += 3)
+    record_array_set(array, i, (record){ .key = i + 1, .weight = i });
+  if (darray_save(array, path) != 0)
+    log_fail(Line":test_file(2): darray_save failed.");
+  if ((mapped = darray_map(path, DARRAY_MAP_READ)) == NULL)
+    log_fail(Line":test_file(2): darray_map returned NULL.");
+  if (darray_size(mapped) != darray_size(array)
+      || darray_largest(mapped) != darray_largest(array))
+    log_fail(Line":test_file(2): size and largest should be restored.");
+  for (int i = 0; i < FILE_COUNT + 10; i++) {
+    if (record_array_get(mapped, i).key != record_array_get(array, i).key)
+      log_fail(Line":test_file(2): mapped array differs.");
+  }
+
+  /* Test 3 -- a read-only mapping refuses every write, rather than faulting */
+  int idx = 3;
+  void * data = &idx;
+  if (record_array_set(mapped, 3, (record){ .key = -1 }) != -1
+      || record_array_ptr(mapped, 3) != NULL
+      || darray_set(mapped, 3, data) != -1
+      || darray_set_many(mapped, &idx, &data, 1) != -1
+      || darray_fill(mapped, 0, 10, data) != -1
+      || darray_sort(mapped, cmp_record) != -1
+      || darray_compact(mapped, NULL, NULL) != -1
+      || darray_reserve(mapped, FILE_COUNT * 2) != -1
+      || darray_shrink_to_fit(mapped) != -1)
+    log_fail(Line":test_file(3): a read-only mapping should be refused.");
+  if (record_array_get(mapped, 3).key != 4)
+    log_fail(Line":test_file(3): the mapping was changed.");
+  record_array_destroy(&mapped);
+
+  /* Test 4 -- changes to a private mapping do not reach the file */
+  if ((mapped = darray_map(path, DARRAY_MAP_PRIVATE)) == NULL)
+    log_fail(Line":test_file(4): darray_map returned NULL.");
+  record_array_set(mapped, 3, (record){ .key = -1 });
+  record_array_set(mapped, FILE_COUNT * 4, (record){ .key = -2 });
+  if (record_array_get(mapped, 3).key != -1
+      || record_array_get(mapped, FILE_COUNT * 4).key != -2)
+    log_fail(Line":test_file(4): private mapping should be writable.");
+  record_array_destroy(&mapped);
+  if ((mapped = darray_map(path, DARRAY_MAP_READ)) == NULL
+      || record_array_get(mapped, 3).key != 4
+      || darray_largest(mapped) != darray_largest(array))
+    log_fail(Line":test_file(4): file should be unchanged.");
+  record_array_destroy(&mapped);
+
+  /* Test 5 -- files which are not darray files are refused */
+  if ((fd = open(path, O_WRONLY | O_TRUNC)) < 0
+      || write(fd, "not a darray", 12) != 12)
+    log_fail(Line":test_file(5): could not overwrite the file.");
+  close(fd);
+  if (darray_map(path, DARRAY_MAP_READ) != NULL
+      || darray_map("/nonexistent/darray", DARRAY_MAP_READ) != NULL)
+    log_fail(Line":test_file(5): should refuse a bad file.");
+
+  record_array_destroy(&array);
+  unlink(path);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_stream
+ *
+ * DESCRIPTION:	    Tests the darray_write() and darray_read() functions over
+ *		    a pipe, with a writer thread on the other end.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define STREAM_COUNT 100000
+static int test_stream() {
+
+  static int nums[STREAM_COUNT];
+  const darray_codec codec = {
+    .size = sizeof(int),
+    .encode = encode_int,
+    .decode = decode_int,
+    .ctx = NULL
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  pthread_t thread;
+  int fds[2];
+
+  /* Test 1 -- an array of inline values, dense and then sparse */
+  for (int sparse = 0; sparse <= 1; sparse++) {
+    record_array * array = NULL, * copy = NULL;
+    config.elsize = sizeof(record);
+    config.page = sparse ? 1024 : 0;
+    if ((array = darray_create_ex(&config)) == NULL)
+      log_fail(Line":test_stream(1): darray_create_ex returned NULL.");
+    for (int i = 0; i < STREAM_COUNT; i += 7)
+      record_array_set(array, i * (sparse ? 50 : 1), (record){ .key = i + 1 });
+
+    void * args[3] = { array, &fds[1], NULL };
+    if (pipe(fds) || pthread_create(&thread, NULL, write_worker, args))
+      log_fail(Line":test_stream(1): could not start the writer.");
+    copy = darray_read(fds[0], NULL, NULL);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    if (copy == NULL || darray_size(copy) != darray_size(array)
+	|| darray_largest(copy) != darray_largest(array))
+      log_fail(Line":test_stream(1): darray_read failed.");
+    for (int i = 0; i <= darray_largest(array); i += (sparse ? 50 : 1)) {
+      if (record_array_get(copy, i).key != record_array_get(array, i).key)
+	log_fail(Line":test_stream(1): copy differs.");
+    }
+    record_array_destroy(&copy);
+    record_array_destroy(&array);
+  }
+
+  /* Test 2 -- an array of pointers, through a codec */
+  darray * array = NULL, * copy = NULL;
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_stream(2): darray_create returned NULL.");
+  for (int i = 0; i < STREAM_COUNT; i++) {
+    nums[i] = i;
+    if (i % 3)
+      darray_set(array, i, &nums[i]);
+  }
+
+  void * args[3] = { array, &fds[1], (void *)&codec };
+  if (pipe(fds) || pthread_create(&thread, NULL, write_worker, args))
+    log_fail(Line":test_stream(2): could not start the writer.");
+  config = (darray_config)DARRAY_CONFIG_DEFAULT;
+  config.destroy = free;
+  copy = darray_read(fds[0], &codec, &config);
+  pthread_join(thread, NULL);
+  close(fds[0]);
+
+  if (copy == NULL || darray_size(copy) != darray_size(array))
+    log_fail(Line":test_stream(2): darray_read failed.");
+  for (int i = 0; i < STREAM_COUNT; i++) {
+    int * p = darray_get(copy, i);
+    if (i % 3 ? p == NULL || *p != i : p != NULL)
+      log_fail(Line":test_stream(2): copy differs.");
+  }
+
+  /* Test 3 -- the bitmaps of the copy are kept */
+  if (copy->untracked != 0 || darray_next(copy, 3) != 4
+      || darray_prev(copy, 3) != 2 || darray_min(copy) != 1)
+    log_fail(Line":test_stream(3): the bitmaps were not rebuilt.");
+  darray_destroy(&copy);
+
+  /* Test 4 -- pointers cannot be streamed without a codec, and garbage is
+   * refused
+   */
+  if (darray_write(array, 1, NULL) != -1)
+    log_fail(Line":test_stream(4): should refuse an array of pointers.");
+  if (pipe(fds) || write(fds[1], "not a darray stream, at all", 27) != 27)
+    log_fail(Line":test_stream(4): could not write to the pipe.");
+  close(fds[1]);
+  if (darray_read(fds[0], &codec, NULL) != NULL)
+    log_fail(Line":test_stream(4): should refuse a bad stream.");
+  close(fds[0]);
+  darray_destroy(&array);
+
+  /* Test 5 -- a stream cut short in its last run is refused, and the
+   * elements decoded from the runs before it are destroyed
+   */
+  static char stream[8192];
+  ssize_t length = 0;
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_stream(5): darray_create returned NULL.");
+  for (int i = 0; i < 1000; i++) {
+    if (i % 3)
+      darray_set(array, i, &nums[i]);
+  }
+  if (pipe(fds) || darray_write(array, fds[1], &codec) != 0)
+    log_fail(Line":test_stream(5): darray_write failed.");
+  close(fds[1]);
+  if ((length = read(fds[0], stream, sizeof(stream))) <= 0
+      || (size_t)length >= sizeof(stream))
+    log_fail(Line":test_stream(5): could not read the stream.");
+  close(fds[0]);
+  if (pipe(fds) || write(fds[1], stream, length - 24) != length - 24)
+    log_fail(Line":test_stream(5): could not write to the pipe.");
+  close(fds[1]);
+  destroyed = 0;
+  config.destroy = free_destroy;
+  if (darray_read(fds[0], &codec, &config) != NULL)
+    log_fail(Line":test_stream(5): should refuse a cut stream.");
+  close(fds[0]);
+  if (destroyed != 504 - 504 / 3)
+    log_fail(Line":test_stream(5): decoded elements were not destroyed.");
+
+  /* Test 6 -- the largest index is taken from the runs read, not from the
+   * header of the stream
+   */
+  int64_t forged = 5000;
+  memcpy(stream + 48, &forged, sizeof(forged));
+  if (pipe(fds) || write(fds[1], stream, length) != length)
+    log_fail(Line":test_stream(6): could not write to the pipe.");
+  close(fds[1]);
+  if ((copy = darray_read(fds[0], &codec, &config)) == NULL)
+    log_fail(Line":test_stream(6): darray_read failed.");
+  close(fds[0]);
+  if (darray_largest(copy) != 998 || darray_size(copy) != darray_size(array)
+      || darray_push(copy, malloc(sizeof(int))) != 999)
+    log_fail(Line":test_stream(6): largest should be 998.");
+  destroyed = 0;
+  darray_destroy(&copy);
+  if (destroyed != 667)
+    log_fail(Line":test_stream(6): the copy should destroy its elements.");
+
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_stats
+ *
+ * DESCRIPTION:	    Tests the darray_stats() and darray_stats_reset()
+ *		    functions. The counters are only checked when compiled
+ *		    with CONFIG_DARRAY_STATS.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_stats() {
+
+  darray * array = NULL;
+  darray_statistics st;
+  darray_cursor cursor = DARRAY_CURSOR_INIT;
+  int num = 0;
+
+  /* Test 1 -- 100 elements fill landings of 8, 16, 32 and 64 slots */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_stats(1): darray_create returned NULL.");
+  for (int i = 0; i < 100; i++) {
+    darray_set(array, i, &num);
+    darray_get(array, i);
+    darray_cursor_get(array, &cursor, i);
+  }
+  if (darray_stats(array, &st) || st.used != 100 || st.slots != 120
+      || st.bytes <= sizeof(darray) + 112 * sizeof(void *))
+    log_fail(Line":test_stats(1): wrong memory figures.");
+#ifdef CONFIG_DARRAY_STATS
+  if (st.sets != 100 || st.gets != 200 || st.cursor_misses != 4
+      || st.cursor_hits != 96 || st.landings_allocated != 4
+      || st.landings_freed != 0)
+    log_fail(Line":test_stats(1): wrong counters.");
+#endif
+
+  /* Test 2 -- a reset clears the counters, but not the memory figures */
+  darray_stats_reset(array);
+  if (darray_stats(array, &st) || st.gets != 0 || st.sets != 0
+      || st.cursor_hits != 0 || st.landings_allocated != 0 || st.used != 100)
+    log_fail(Line":test_stats(2): reset failed.");
+
+  /* Test 3 -- clearing all but index 0 walks back down to it, and releases
+   * all but the first landing and the spare
+   */
+  darray_fill(array, 1, 100, NULL);
+  if (darray_stats(array, &st) || st.used != 1 || st.slots != 24)
+    log_fail(Line":test_stats(3): wrong memory figures.");
+#ifdef CONFIG_DARRAY_STATS
+  if (st.sets != 99 || st.landings_freed != 2 || st.walked == 0)
+    log_fail(Line":test_stats(3): wrong counters.");
+#endif
+  darray_destroy(&array);
+
+  /* Test 4 -- a sparse array counts only the page which is written */
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.page = 64;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_stats(4): darray_create_ex returned NULL.");
+  darray_set(array, 100000, &num);
+  if (darray_stats(array, &st) || st.slots != 64 || st.used != 1)
+    log_fail(Line":test_stats(4): wrong memory figures.");
+#ifdef CONFIG_DARRAY_STATS
+  if (st.landings_allocated != 1 || st.pages_allocated != 1)
+    log_fail(Line":test_stats(4): wrong counters.");
+#endif
+  darray_destroy(&array);
+
+  if (darray_stats(NULL, &st) != -1)
+    log_fail(Line":test_stats(5): should refuse a NULL array.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_occupancy
+ *
+ * DESCRIPTION:	    Tests the darray_min(), darray_next() and darray_prev()
+ *		    functions against a linear scan, for dense, sparse and
+ *		    concurrent arrays, and for arrays of values.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+#define OCCUPANCY_COUNT 50000
+static int test_occupancy() {
+
+  static char full[OCCUPANCY_COUNT];
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  int num = 0, count = 0;
+
+  /* Test 1 -- a thinly filled array, with some elements removed again */
+  for (int kind = 0; kind < 3; kind++) {
+    darray * array = NULL;
+    config.page = kind == 1 ? 256 : 0;
+    config.concurrent = kind == 2;
+    if ((array = darray_create_ex(&config)) == NULL)
+      log_fail(Line":test_occupancy(1): darray_create_ex returned NULL.");
+
+    memset(full, 0, sizeof(full));
+    for (int i = 0; i < OCCUPANCY_COUNT / 100; i++) {
+      int index = rand() % (OCCUPANCY_COUNT - 1000) + 500;
+      full[index] = 1;
+      darray_set(array, index, &num);
+    }
+    for (int i = 0; i < OCCUPANCY_COUNT; i += 3) {
+      if (full[i] && i % 2) {
+	full[i] = 0;
+	darray_set(array, i, NULL);
+      }
+    }
+
+    long long expect = -1;
+    for (int i = 0; expect < 0 && i < OCCUPANCY_COUNT; i++)
+      expect = full[i] ? i : -1;
+    if (darray_min(array) != expect)
+      log_fail(Line":test_occupancy(1): wrong darray_min.");
+    for (int i = 0; i < OCCUPANCY_COUNT; i += 37) {
+      long long next = -1, prev = -1;
+      for (int j = i + 1; next < 0 && j < OCCUPANCY_COUNT; j++)
+	next = full[j] ? j : -1;
+      for (int j = i - 1; prev < 0 && j >= 0; j--)
+	prev = full[j] ? j : -1;
+      if (darray_next(array, i) != next || darray_prev(array, i) != prev)
+	log_fail(Line":test_occupancy(1): wrong darray_next/prev.");
+    }
+
+    count = 0;
+    if (darray_foreach_nonnull(array, count_seen, &count)
+	|| count != darray_size(array))
+      log_fail(Line":test_occupancy(1): darray_foreach_nonnull missed some.");
+    darray_destroy(&array);
+  }
+
+  /* Test 2 -- values set in place through record_array_ptr are found too */
+  record_array * records = NULL;
+  if ((records = record_array_create(NULL)) == NULL)
+    log_fail(Line":test_occupancy(2): record_array_create returned NULL.");
+  record_array_set(records, 3000, (record){ .key = 1 });
+  record_array_ptr(records, 9000)->key = 2;
+  if (darray_min(records) != 3000 || darray_next(records, 3000) != 9000
+      || darray_prev(records, 9000) != 3000
+      || darray_next(records, 9000) != -1)
+    log_fail(Line":test_occupancy(2): wrong index.");
+
+  record_array_destroy(&records);
+
+  /* Test 3 -- removing the largest element falls back to the one before */
+  darray * array = NULL;
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_occupancy(3): darray_create returned NULL.");
+  darray_set(array, 10, &num);
+  darray_set(array, 40000, &num);
+  darray_set(array, 40000, NULL);
+  if (darray_largest(array) != 10 || darray_prev(array, 40000) != 10)
+    log_fail(Line":test_occupancy(3): largest did not settle.");
+  darray_destroy(&array);
+
+  if (darray_min(NULL) != -1 || darray_next(NULL, 0) != -1)
+    log_fail(Line":test_occupancy(4): should refuse a NULL array.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_init
+ *
+ * DESCRIPTION:	    Tests the darray_init() and darray_fini() functions, and
+ *		    that a small array needs no allocation for its first
+ *		    landing.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_init() {
+
+  static int nums[1000];
+  size_t outstanding = 0;
+  const darray_allocator counter = {
+    .alloc = count_alloc,
+    .zalloc = count_zalloc,
+    .free = count_free,
+    .ctx = &outstanding
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.allocator = &counter;
+  config.destroy = count_destroy;
+  struct { int id; darray items; } session;
+
+  /* Test 1 -- an embedded array of a few elements allocates nothing */
+  if (darray_init(&session.items, sizeof(session.items), &config))
+    log_fail(Line":test_init(1): darray_init failed.");
+  for (int i = 0; i < 5; i++)
+    darray_push(&session.items, &nums[i]);
+  if (outstanding != 0 || darray_size(&session.items) != 5
+      || darray_get(&session.items, 4) != &nums[4])
+    log_fail(Line":test_init(1): the first landing was allocated.");
+
+  /* Test 2 -- it grows past the header as usual, landing directory and all,
+   * and darray_fini frees everything but the header
+   */
+  for (int i = 5; i < 200; i++)
+    darray_push(&session.items, &nums[i]);
+  if (outstanding == 0 || darray_get(&session.items, 199) != &nums[199]
+      || session.items.landing == session.items.directory)
+    log_fail(Line":test_init(2): the array did not grow.");
+  destroyed = 0;
+  darray_fini(&session.items);
+  if (outstanding != 0 || destroyed != 200)
+    log_fail(Line":test_init(2): darray_fini did not release the array.");
+
+  /* Test 3 -- a heap array keeps its first landing in its header too, and
+   * reuses it after contracting
+   */
+  darray * array = NULL;
+  config.destroy = NULL;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_init(3): darray_create_ex returned NULL.");
+  darray_set(array, 3, &nums[3]);
+  darray_set(array, 3, NULL);
+  darray_set_spare(array, 0);
+  darray_set(array, 6, &nums[6]);
+  if (outstanding != sizeof(darray) || darray_get(array, 3) != NULL
+      || darray_get(array, 6) != &nums[6])
+    log_fail(Line":test_init(3): the first landing was not reused.");
+
+  /* Test 4 -- once it shrinks again, the directory moves back into the
+   * header, and the array costs its header alone
+   */
+  for (int i = 7; i < 1000; i++)
+    darray_set(array, i, &nums[i]);
+  darray_fill(array, 7, 1000, NULL);
+  if (darray_shrink_to_fit(array) != 0 || outstanding != sizeof(darray)
+      || array->landing != array->directory
+      || darray_get(array, 6) != &nums[6])
+    log_fail(Line":test_init(4): the directory was not moved back.");
+  darray_destroy(&array);
+
+  if (darray_init(NULL, sizeof(darray), NULL) != -1
+      || darray_init(&session.items, sizeof(darray) - 1, NULL) != -1)
+    log_fail(Line":test_init(5): should refuse a NULL or short array.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_sort
+ *
+ * DESCRIPTION:	    Tests the darray_sort(), darray_parallel_sort() and
+ *		    darray_bsearch() functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_sort() {
+
+  static int nums[5000];
+  darray * array = NULL;
+  record_array * records = NULL;
+  darray_pool * pool = NULL;
+
+  /* Test 1 -- a pointer array sorts across its landings */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_sort(1): darray_create returned NULL.");
+  for (int i = 0; i < 5000; i++) {
+    nums[i] = rand() % 1000;
+    darray_push(array, &nums[i]);
+  }
+  if (darray_sort(array, cmp_int) != 0)
+    log_fail(Line":test_sort(1): darray_sort did not return 0.");
+  for (int i = 1; i < 5000; i++) {
+    if (*(int *)darray_get(array, i - 1) > *(int *)darray_get(array, i))
+      log_fail(Line":test_sort(1): the array is out of order.");
+  }
+  if (darray_size(array) != 5000)
+    log_fail(Line":test_sort(1): elements were lost.");
+
+  /* Test 2 -- darray_bsearch finds the first of equal elements, and
+   * reports missing ones
+   */
+  for (int i = 0; i < 5000; i += 97) {
+    int key = *(int *)darray_get(array, i);
+    long long found = darray_bsearch(array, &key, cmp_key);
+    if (found < 0 || found > i || *(int *)darray_get(array, found) != key
+	|| (found > 0 && *(int *)darray_get(array, found - 1) == key))
+      log_fail(Line":test_sort(2): darray_bsearch found the wrong index.");
+  }
+  int missing = 1000;
+  if (darray_bsearch(array, &missing, cmp_key) != -1)
+    log_fail(Line":test_sort(2): found an element that is not there.");
+  missing = -1;
+  if (darray_bsearch(array, &missing, cmp_key) != -1)
+    log_fail(Line":test_sort(2): found an element that is not there.");
+
+  /* Test 3 -- an array with holes is refused */
+  darray_set(array, 6000, &nums[0]);
+  if (darray_sort(array, cmp_int) != -1)
+    log_fail(Line":test_sort(3): should refuse an array with holes.");
+  darray_destroy(&array);
+
+  /* Test 4 -- a sparse array of values sorts on a pool */
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.elsize = sizeof(record);
+  config.page = 256;
+  long long sum = 0;
+  if ((records = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_sort(4): darray_create_ex returned NULL.");
+  for (int i = 0; i < 100000; i++) {
+    record r = { .key = rand() % 50000, .flags = i, .weight = 0.0 };
+    record_array_set(records, i, r);
+    sum += r.key;
+  }
+  if ((pool = darray_pool_create(4)) == NULL)
+    log_fail(Line":test_sort(4): darray_pool_create returned NULL.");
+  if (darray_parallel_sort(records, pool, cmp_record) != 0)
+    log_fail(Line":test_sort(4): darray_parallel_sort did not return 0.");
+  for (int i = 0; i < 100000; i++) {
+    record r = record_array_get(records, i);
+    if (i > 0 && record_array_get(records, i - 1).key > r.key)
+      log_fail(Line":test_sort(4): the array is out of order.");
+    sum -= r.key;
+  }
+  if (sum != 0)
+    log_fail(Line":test_sort(4): elements were lost.");
+
+  record key = { .key = record_array_get(records, 77777).key };
+  long long found = darray_bsearch(records, &key, cmp_record);
+  if (found < 0 || found > 77777
+      || record_array_get(records, found).key != key.key)
+    log_fail(Line":test_sort(4): darray_bsearch found the wrong index.");
+  darray_pool_destroy(&pool);
+  darray_destroy(&records);
+
+  if (darray_sort(NULL, cmp_int) != -1
+      || darray_bsearch(NULL, &missing, cmp_key) != -1)
+    log_fail(Line":test_sort(5): should refuse a NULL array.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_compact
+ *
+ * DESCRIPTION:	    Tests the darray_compact() function.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_compact() {
+
+  static int nums[1000];
+  static long long moved[1000];
+  darray * array = NULL;
+  darray_statistics before = {0}, after = {0};
+
+  /* Test 1 -- elements keep their order, and each move is reported */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_compact(1): darray_create returned NULL.");
+  for (int i = 0; i < 1000; i++) {
+    moved[i] = -1;
+    darray_set(array, i * 97, &nums[i]);
+  }
+  darray_stats(array, &before);
+  if (darray_compact(array, note_move, moved) != 0)
+    log_fail(Line":test_compact(1): darray_compact did not return 0.");
+  for (int i = 0; i < 1000; i++) {
+    if (darray_get(array, i) != &nums[i])
+      log_fail(Line":test_compact(1): an element was misplaced.");
+    if (moved[i] != (i == 0 ? -1 : i * 97))
+      log_fail(Line":test_compact(1): a move was not reported.");
+  }
+  if (darray_size(array) != 1000 || darray_largest(array) != 999
+      || darray_get(array, 1000) != NULL)
+    log_fail(Line":test_compact(1): the array was not packed.");
+
+  /* Test 2 -- the emptied landings are released, and the bitmaps still
+   * find the elements
+   */
+  darray_stats(array, &after);
+  if (after.bytes >= before.bytes || after.used != 1000)
+    log_fail(Line":test_compact(2): landings were not released.");
+  if (darray_min(array) != 0 || darray_prev(array, 100000) != 999)
+    log_fail(Line":test_compact(2): the bitmaps were not kept.");
+  darray_destroy(&array);
+
+  /* Test 3 -- a sparse array of values releases its pages */
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.elsize = sizeof(record);
+  config.page = 256;
+  record_array * records = NULL;
+  if ((records = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_compact(3): darray_create_ex returned NULL.");
+  for (int i = 1; i <= 3; i++)
+    record_array_set(records, i * 50000, (record){ .key = i });
+  darray_stats(records, &before);
+  if (darray_compact(records, NULL, NULL) != 0)
+    log_fail(Line":test_compact(3): darray_compact did not return 0.");
+  darray_stats(records, &after);
+  for (int i = 0; i < 3; i++) {
+    if (record_array_get(records, i).key != i + 1)
+      log_fail(Line":test_compact(3): an element was misplaced.");
+  }
+  if (darray_largest(records) != 2 || after.bytes >= before.bytes)
+    log_fail(Line":test_compact(3): pages were not released.");
+  darray_destroy(&records);
+
+  /* Test 4 -- concurrent arrays are refused */
+  config = (darray_config)DARRAY_CONFIG_DEFAULT;
+  config.concurrent = 1;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_compact(4): darray_create_ex returned NULL.");
+  if (darray_compact(array, NULL, NULL) != -1
+      || darray_compact(NULL, NULL, NULL) != -1)
+    log_fail(Line":test_compact(4): should refuse the array.");
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_clone
+ *
+ * DESCRIPTION:	    Tests the darray_clone() and darray_unshare() functions,
+ *		    and that a landing is only copied when it is first written.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_clone() {
+
+  static int nums[1000];
+  size_t outstanding = 0;
+  const darray_allocator counter = {
+    .alloc = count_alloc,
+    .zalloc = count_zalloc,
+    .free = count_free,
+    .ctx = &outstanding
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.allocator = &counter;
+  config.destroy = count_destroy;
+  darray * array = NULL, * snap = NULL;
+
+  /* Test 1 -- a clone costs its header and directory, and reads the same */
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_clone(1): darray_create_ex returned NULL.");
+  for (int i = 0; i < 1000; i++)
+    darray_push(array, &nums[i]);
+  size_t before = outstanding;
+  size_t header = sizeof(darray) + DARRAY_MAX_LANDINGS * sizeof(void **);
+  if ((snap = darray_clone(array)) == NULL)
+    log_fail(Line":test_clone(1): darray_clone returned NULL.");
+  if (outstanding != before + header || darray_size(snap) != 1000
+      || darray_largest(snap) != 999 || darray_get(snap, 999) != &nums[999])
+    log_fail(Line":test_clone(1): the clone should share every landing.");
+
+  /* Test 2 -- the first write copies one landing, and later ones none */
+  before = outstanding;
+  darray_set(array, 900, NULL);
+  size_t copied = outstanding - before;
+  darray_set(array, 901, &nums[0]);
+  darray_set(snap, 902, &nums[0]);
+  if (copied == 0 || copied >= 1000 * sizeof(void *)
+      || outstanding != before + copied)
+    log_fail(Line":test_clone(2): the landing should be copied once.");
+  if (darray_get(array, 900) != NULL || darray_get(snap, 900) != &nums[900]
+      || darray_get(snap, 901) != &nums[901]
+      || darray_get(array, 902) != &nums[902] || darray_size(snap) != 1000)
+    log_fail(Line":test_clone(2): a write was seen by the other array.");
+
+  /* Test 3 -- either array may go first, and the clone destroys nothing */
+  destroyed = 0;
+  darray_destroy(&array);
+  if (destroyed != 999 || darray_get(snap, 500) != &nums[500]
+      || darray_next(snap, 899) != 900)
+    log_fail(Line":test_clone(3): the clone lost its landings.");
+  darray_destroy(&snap);
+  if (outstanding != 0 || destroyed != 999)
+    log_fail(Line":test_clone(3): landings were leaked or destroyed twice.");
+
+  /* Test 4 -- a sparse array copies only the page written */
+  for (int i = 0; i < 4; i++)
+    nums[i] = i;
+  config.destroy = NULL;
+  config.page = 256;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_clone(4): darray_create_ex returned NULL.");
+  darray_fill(array, 0, 4096, &nums[1]);
+  if ((snap = darray_clone(array)) == NULL)
+    log_fail(Line":test_clone(4): darray_clone returned NULL.");
+  before = outstanding;
+  darray_set(snap, 4000, &nums[2]);
+  if (outstanding - before >= 512 * sizeof(void *)
+      || darray_get(array, 4000) != &nums[1])
+    log_fail(Line":test_clone(4): more than the page was copied.");
+
+  /* Test 5 -- darray_unshare copies the rest, and a shared array sorts
+   * without disturbing its clone
+   */
+  before = outstanding;
+  if (darray_unshare(array) != 0 || outstanding <= before)
+    log_fail(Line":test_clone(5): darray_unshare copied nothing.");
+  darray_destroy(&array);
+  darray_set(snap, 0, &nums[3]);
+  if ((array = darray_clone(snap)) == NULL
+      || darray_sort(array, cmp_int) != 0)
+    log_fail(Line":test_clone(5): the clone could not be sorted.");
+  if (darray_get(array, 4095) != &nums[3]
+      || darray_get(array, 4094) != &nums[2]
+      || darray_get(snap, 0) != &nums[3]
+      || darray_get(snap, 4000) != &nums[2])
+    log_fail(Line":test_clone(5): the sort was seen by the other array.");
+  darray_destroy(&array);
+  darray_destroy(&snap);
+  if (outstanding != 0)
+    log_fail(Line":test_clone(5): landings were leaked.");
+
+  /* Test 6 -- a write through the clone leaves the cursor of the other
+   * array valid, and the reset cursor of the clone sees it
+   */
+  darray_cursor cursor = DARRAY_CURSOR_INIT, snap_cursor = DARRAY_CURSOR_INIT;
+  config.page = 0;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_clone(6): darray_create_ex returned NULL.");
+  for (int i = 0; i < 1000; i++)
+    darray_push(array, &nums[i]);
+  if ((snap = darray_clone(array)) == NULL
+      || darray_cursor_get(array, &cursor, 500) != &nums[500]
+      || darray_cursor_get(snap, &snap_cursor, 500) != &nums[500])
+    log_fail(Line":test_clone(6): darray_clone failed.");
+  darray_set(snap, 501, &nums[0]);
+  snap_cursor = (darray_cursor)DARRAY_CURSOR_INIT;
+  if (darray_cursor_get(array, &cursor, 501) != &nums[501]
+      || darray_cursor_get(snap, &snap_cursor, 501) != &nums[0])
+    log_fail(Line":test_clone(6): a cursor read the wrong landing.");
+  darray_set(array, 502, &nums[1]);
+  cursor = (darray_cursor)DARRAY_CURSOR_INIT;
+  if (darray_cursor_get(array, &cursor, 502) != &nums[1]
+      || darray_cursor_get(snap, &snap_cursor, 502) != &nums[502])
+    log_fail(Line":test_clone(6): a write was seen by the other array.");
+  darray_destroy(&array);
+  darray_destroy(&snap);
+  if (outstanding != 0)
+    log_fail(Line":test_clone(6): landings were leaked.");
+
+  /* Test 7 -- concurrent arrays are refused */
+  config = (darray_config)DARRAY_CONFIG_DEFAULT;
+  config.concurrent = 1;
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_clone(7): darray_create_ex returned NULL.");
+  if (darray_clone(array) != NULL || darray_clone(NULL) != NULL)
+    log_fail(Line":test_clone(7): should refuse the array.");
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_reserve
+ *
+ * DESCRIPTION:	    Tests the darray_reserve() and darray_shrink_to_fit()
+ *		    functions.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_reserve() {
+
+  static int nums[1000];
+  size_t outstanding = 0;
+  const darray_allocator counter = {
+    .alloc = count_alloc,
+    .zalloc = count_zalloc,
+    .free = count_free,
+    .ctx = &outstanding
+  };
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.allocator = &counter;
+  darray * array = NULL, * snap = NULL;
+
+  /* Test 1 -- every landing lies within one allocation, and filling the
+   * array allocates nothing more
+   */
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_reserve(1): darray_create_ex returned NULL.");
+  if (darray_reserve(array, 1000) != 0)
+    log_fail(Line":test_reserve(1): darray_reserve did not return 0.");
+  size_t reserved = outstanding;
+  if (array->block == NULL || array->landings != 7)
+    log_fail(Line":test_reserve(1): the landings were not carved.");
+  for (int n = 2; n < array->landings; n++) {
+    if ((char *)array->landing[n] <= (char *)array->landing[n - 1]
+	|| (char *)array->landing[n] >= (char *)array->landing[1]
+	+ reserved - sizeof(darray))
+      log_fail(Line":test_reserve(1): the landings are not adjacent.");
+  }
+  for (int i = 0; i < 1000; i++)
+    darray_push(array, &nums[i]);
+  if (outstanding != reserved || darray_get(array, 999) != &nums[999])
+    log_fail(Line":test_reserve(1): filling the array allocated.");
+
+  /* Test 2 -- after contracting, darray_shrink_to_fit moves what is left
+   * out of the block, and frees it
+   */
+  darray_fill(array, 10, 1000, NULL);
+  if (darray_shrink_to_fit(array) != 0)
+    log_fail(Line":test_reserve(2): darray_shrink_to_fit did not return 0.");
+  if (array->block != NULL || outstanding >= reserved / 4
+      || darray_get(array, 9) != &nums[9] || darray_size(array) != 10)
+    log_fail(Line":test_reserve(2): the block was not freed.");
+  darray_destroy(&array);
+  if (outstanding != 0)
+    log_fail(Line":test_reserve(2): memory was leaked.");
+
+  /* Test 3 -- the reserved landings survive the array emptying and
+   * compacting, until darray_shrink_to_fit
+   */
+  if ((array = darray_create_ex(&config)) == NULL
+      || darray_reserve(array, 1000) != 0)
+    log_fail(Line":test_reserve(3): darray_reserve failed.");
+  darray_set_spare(array, 0);
+  darray_set(array, 0, &nums[0]);
+  darray_set(array, 0, NULL);
+  darray_fill(array, 0, 1000, &nums[1]);
+  darray_fill(array, 0, 1000, NULL);
+  darray_set(array, 900, &nums[2]);
+  darray_compact(array, NULL, NULL);
+  if (array->landings != 7 || outstanding != reserved
+      || darray_get(array, 0) != &nums[2] || darray_size(array) != 1)
+    log_fail(Line":test_reserve(3): the reserved landings were released.");
+  darray_set(array, 0, NULL);
+  if (darray_shrink_to_fit(array) != 0 || array->landings != 0
+      || array->block != NULL)
+    log_fail(Line":test_reserve(3): darray_shrink_to_fit kept landings.");
+  darray_destroy(&array);
+  if (outstanding != 0)
+    log_fail(Line":test_reserve(3): memory was leaked.");
+
+  /* Test 4 -- a clone may outlive the array holding the block */
+  if ((array = darray_create_ex(&config)) == NULL
+      || darray_reserve(array, 5000) != 0)
+    log_fail(Line":test_reserve(4): darray_reserve failed.");
+  darray_fill(array, 0, 5000, &nums[0]);
+  if ((snap = darray_clone(array)) == NULL)
+    log_fail(Line":test_reserve(4): darray_clone returned NULL.");
+  darray_set(array, 4000, NULL);
+  darray_destroy(&array);
+  if (darray_get(snap, 4000) != &nums[0] || darray_size(snap) != 5000)
+    log_fail(Line":test_reserve(4): the clone lost its landings.");
+  darray_destroy(&snap);
+  if (outstanding != 0)
+    log_fail(Line":test_reserve(4): memory was leaked.");
+
+  /* Test 5 -- a sparse array does not allocate its pages */
+  config.page = 64;
+  if ((array = darray_create_ex(&config)) == NULL
+      || darray_reserve(array, 10000) != 0)
+    log_fail(Line":test_reserve(5): darray_reserve failed.");
+  if (darray_slot(array, 20, 0) == NULL || darray_slot(array, 9000, 0) != NULL)
+    log_fail(Line":test_reserve(5): should allocate only unpaged landings.");
+  darray_set(array, 9000, &nums[1]);
+  if (darray_get(array, 9000) != &nums[1])
+    log_fail(Line":test_reserve(5): the page was not allocated.");
+  darray_destroy(&array);
+
+  /* Test 6 -- a reservation which could not be allocated is not kept */
+  if ((array = darray_create(NULL)) == NULL)
+    log_fail(Line":test_reserve(6): darray_create returned NULL.");
+  if (darray_reserve(array, 1ll << 44) != -1 || array->reserved != 0)
+    log_fail(Line":test_reserve(6): the failed reservation was kept.");
+  darray_destroy(&array);
+
+  if (darray_reserve(NULL, 10) != -1 || darray_shrink_to_fit(NULL) != -1)
+    log_fail(Line":test_reserve(7): should refuse a NULL array.");
+  if (outstanding != 0)
+    log_fail(Line":test_reserve(7): memory was leaked.");
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    test_large
+ *
+ * DESCRIPTION:	    Tests that a landing above CONFIG_DARRAY_MMAP_THRESHOLD
+ *		    reads as zero, and costs resident memory only for the
+ *		    pages which are touched.
+ *
+ * ARGUMENTS:	    void.
+ *
+ * RETURN:	    int -- 0 if the tests pass, 1 if they fail.
+ *
+ * NOTES:	    none.
+ ***/
+static int test_large() {
+
+  static int nums[2];
+  struct rusage before = {0}, after = {0};
+  darray_config config = DARRAY_CONFIG_DEFAULT;
+  config.first = 1 << 23;
+  darray * array = NULL;
+
+  /* Test 1 -- a 64MiB landing is zero, without being touched */
+  getrusage(RUSAGE_SELF, &before);
+  if ((array = darray_create_ex(&config)) == NULL)
+    log_fail(Line":test_large(1): darray_create_ex returned NULL.");
+  if (darray_set(array, 3, &nums[0]) || darray_set(array, (1 << 23) - 1,
+						    &nums[1]))
+    log_fail(Line":test_large(1): darray_set did not return 0.");
+  getrusage(RUSAGE_SELF, &after);
+  if (darray_get(array, 3) != &nums[0] || darray_get(array, 1 << 22) != NULL
+      || darray_next(array, 3) != (1 << 23) - 1)
+    log_fail(Line":test_large(1): the landing is not zero.");
+  if (after.ru_maxrss - before.ru_maxrss > 16 * 1024)
+    log_fail(Line":test_large(1): the whole landing became resident.");
+
+  /* Test 2 -- it is unmapped when the array contracts */
+  darray_set(array, (1 << 23) - 1, NULL);
+  darray_set(array, 3, NULL);
+  darray_set_spare(array, 0);
+  if (darray_size(array) != 0 || array->landings != 0)
+    log_fail(Line":test_large(2): the landing was not released.");
+  darray_destroy(&array);
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_seen
+ *
+ * DESCRIPTION:	    Callback for darray_foreach_nonnull() which counts the
+ *		    elements it is given in the int pointed to by `ctx'.
+ *
+ * ARGUMENTS:	    index: (long long) -- Unused.
+ *		    data: (void *) -- Unused.
+ *		    ctx: (void *) -- Pointer to the running count.
+ *
+ * RETURN:	    int -- 0, to continue the iteration.
+ *
+ * NOTES:	    none.
+ ***/
+static int count_seen(long long index, void * data, void * ctx)
+{
+  (void)index;
+  (void)data;
+  (*(int *)ctx)++;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_span
+ *
+ * DESCRIPTION:	    Callback for darray_foreach_span() which adds the length
+ *		    of each span to the int pointed to by `ctx'.
+ *
+ * ARGUMENTS:	    base: (void **) -- Unused.
+ *		    first: (long long) -- Unused.
+ *		    count: (int) -- The length of the span.
+ *		    ctx: (void *) -- Pointer to the running count.
+ *
+ * RETURN:	    int -- 0, to continue the iteration.
+ *
+ * NOTES:	    none.
+ ***/
+static int count_span(void ** base, long long first, int count,
+		      void * ctx)
+{
+  (void)base;
+  (void)first;
+  *(int *)ctx += count;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    count_nonnull
+ *
+ * DESCRIPTION:	    Callback for darray_foreach_nonnull() which increments the
+ *		    int pointed to by `ctx', provided `data' matches `index'.
+ *
+ * ARGUMENTS:	    index: (long long) -- The index of the element.
+ *		    data: (void *) -- The user field at `index'.
+ *		    ctx: (void *) -- Pointer to the running count.
+ *
+ * RETURN:	    int -- 0, to continue the iteration, 1 on a mismatch.
+ *
+ * NOTES:	    none.
+ ***/
+static int count_nonnull(long long index, void * data, void * ctx)
+{
+  if (index == 100 ? *(int *)data != 100 : *(int *)data != 9 - index)
+    return 1;
+  (*(int *)ctx)++;
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION:	    prep_darray
+ *
+ * DESCRIPTION:	    Prepare a Dynamic Array with some random data for testing.
+ *
+ * ARGUMENTS:	    random: (int) -- if !0, fill the darray with random data.
+ *
+ * RETURN:	    darray * -- Pointer to a new dynamic array struct.
+ *
+ * NOTES:	    none.
+ ***/
+static darray * prep_darray(int random)
+{
+  darray * array = NULL;
+  if ((array = darray_create(free)) == NULL) {
+    log(Line":prep_darray: darray_create returned NULL\n");
+    return NULL;
+  }
+
+  static int tmp[] = {9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+
+  int * pNum = NULL;
+  for (int i = 0; i < 10; i++) {
+    if ((pNum = malloc(sizeof(int))) == NULL) {
+      log(Line":prep_darray: malloc returned NULL\n");
+      return NULL;
+    }
+    if (random)
+      *pNum = rand() % 10;
+    else
+      *pNum = tmp[i];
+    darray_set(array, i, (void *)pNum);
+  }
+
+  if (darray_size(array) <= 0) {
+    log(Line":prep_darray: darray_size is <= 0\n");
+    return NULL;
+  }
+
+  return array;
+}
+
+/******************************************************************************
+ * FUNCTION:	    cmp_int
+ *
+ * DESCRIPTION:	    Compares the integers pointed to by two slots.
+ *
+ * ARGUMENTS:	    a: (const void *) -- The first slot.
+ *		    b: (const void *) -- The second slot.
+ *
+ * RETURN:	    int -- less than, equal to, or greater than zero.
+ *
+ * NOTES:	    none.
+ ***/
+static int cmp_int(const void * a, const void * b)
+{
+  int x = **(int * const *)a, y = **(int * const *)b;
+  return (x > y) - (x < y);
+}
+
+/******************************************************************************
+ * FUNCTION:	    cmp_key
+ *
+ * DESCRIPTION:	    Compares an integer with the integer pointed to by a slot.
+ *
+ * ARGUMENTS:	    key: (const void *) -- The integer.
+ *		    slot: (const void *) -- The slot.
+ *
+ * RETURN:	    int -- less than, equal to, or greater than zero.
+ *
+ * NOTES:	    none.
+ ***/
+static int cmp_key(const void * key, const void * slot)
+{
+  int x = *(const int *)key, y = **(int * const *)slot;
+  return (x > y) - (x < y);
+}
+
+/******************************************************************************
+ * FUNCTION:	    cmp_record
+ *
+ * DESCRIPTION:	    Compares two records by key.
+ *
+ * ARGUMENTS:	    a: (const void *) -- The first record.
+ *		    b: (const void *) -- The second record.
+ *
+ * RETURN:	    int -- less than, equal to, or greater than zero.
+ *
+ * NOTES:	    none.
+ ***/
+static int cmp_record(const void * a, const void * b)
+{
+  int x = ((const record *)a)->key, y = ((const record *)b)->key;
+  return (x > y) - (x < y);
+}
+
+/******************************************************************************
+ * FUNCTION:	    note_move
+ *
+ * DESCRIPTION:	    Records the old index of an element moved by
+ *		    darray_compact(), at its new index.
+ *
+ * ARGUMENTS:	    from: (long long) -- The old index.
+ *		    to: (long long) -- The new index.
+ *		    ctx: (void *) -- The table of old indices.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void note_move(long long from, long long to, void * ctx)
+{
+  ((long long *)ctx)[to] = from;
+}
+
+/******************************************************************************
+ * FUNCTION:	    lazy_alloc
+ *
+ * DESCRIPTION:	    Maps zeroed memory without reserving swap for it, so that
+ *		    landings far larger than the machine may be allocated as
+ *		    long as little of them is touched.
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    size: (size_t) -- The number of bytes to allocate.
+ *
+ * RETURN:	    void * -- Pointer to the zeroed memory, or NULL.
+ *
+ * NOTES:	    none.
+ ***/
+static void * lazy_alloc(void * ctx, size_t size)
+{
+  (void)ctx;
+  void * ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/******************************************************************************
+ * FUNCTION:	    lazy_free
+ *
+ * DESCRIPTION:	    Unmaps memory mapped by lazy_alloc().
+ *
+ * ARGUMENTS:	    ctx: (void *) -- Unused.
+ *		    ptr: (void *) -- The memory to free.
+ *		    size: (size_t) -- The size it was allocated with.
+ *
+ * RETURN:	    void
+ *
+ * NOTES:	    none.
+ ***/
+static void lazy_free(void * ctx, void * ptr, size_t size)
+{
+  (void)ctx;
+  munmap(ptr, size);
 }
 
 /*****************************************************************************/